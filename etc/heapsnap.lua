@@ -0,0 +1,177 @@
+-- $Id: heapsnap.lua $
+-- Offline analyzer for heap snapshots written by 'lua_heapsnapshot'
+-- (or 'debug.heapsnapshot').
+-- 堆快照的离线分析器
+-- See Copyright Notice in lua.h
+--
+-- usage: lua heapsnap.lua snapshot [n]
+--
+-- Prints the memory in use by each type and the 'n' objects (default
+-- 20) with the largest retained sizes. The retained size of an object
+-- is the memory that would be freed if that object were collected,
+-- that is, the total size of the objects it dominates in the graph of
+-- references starting at the roots. References from weak tables (the
+-- field "weak" of a snapshot) do not keep objects alive, so they are
+-- left out of that graph; objects reachable only through them count as
+-- unreachable. A value in an ephemeron table (field "ephemerons") is
+-- taken as referred to by its key.
+
+local fname = arg[1] or error("usage: lua heapsnap.lua snapshot [n]")
+local ntop = tonumber(arg[2]) or 20
+
+local function refsof (line, field)
+  local refs = {}
+  local list = line:match('"' .. field .. '":%[(.-)%]')
+  for r in (list or ""):gmatch('"([^"]+)"') do
+    refs[#refs + 1] = r
+  end
+  return refs
+end
+
+
+-- read snapshot
+local roots
+local objs = {}   -- objs[id] = {type=, size=, refs=, name=}
+local ephemerons = {}   -- pairs key-value from ephemeron tables
+for line in io.lines(fname) do
+  if not roots then
+    roots = {}
+    for r in line:match('"roots":%[(.-)%]'):gmatch('"([^"]+)"') do
+      roots[#roots + 1] = r
+    end
+  else
+    local id = line:match('^{"id":"([^"]+)"')
+    objs[id] = {
+      type = line:match('"type":"([^"]+)"'),
+      size = tonumber(line:match('"size":(%d+)')),
+      refs = refsof(line, "refs"),
+      name = line:match('"name":"(.*)"}$'),
+    }
+    for _, r in ipairs(refsof(line, "ephemerons")) do
+      ephemerons[#ephemerons + 1] = r
+    end
+  end
+end
+
+for i = 1, #ephemerons, 2 do
+  local key = objs[ephemerons[i]]
+  if key then
+    key.refs[#key.refs + 1] = ephemerons[i + 1]
+  end
+end
+
+
+-- depth-first search from a virtual root numbering nodes in postorder
+local ROOT = {}
+local order = {}    -- nodes in reverse postorder
+local index = {}    -- index[node] = position in 'order'
+local preds = {}    -- preds[node] = list of predecessors
+local function succs (node)
+  return (node == ROOT) and roots or objs[node].refs
+end
+
+do
+  local post = {}
+  local visited = {[ROOT] = true}
+  local stack = {{node = ROOT, i = 0}}
+  while #stack > 0 do
+    local top = stack[#stack]
+    local s = succs(top.node)
+    top.i = top.i + 1
+    local child = s[top.i]
+    if child == nil then
+      post[#post + 1] = top.node
+      stack[#stack] = nil
+    elseif objs[child] then
+      local p = preds[child]
+      if not p then p = {}; preds[child] = p end
+      p[#p + 1] = top.node
+      if not visited[child] then
+        visited[child] = true
+        stack[#stack + 1] = {node = child, i = 0}
+      end
+    end
+  end
+  for i = #post, 1, -1 do
+    order[#order + 1] = post[i]
+    index[post[i]] = #order
+  end
+end
+
+
+-- immediate dominators ("A Simple, Fast Dominance Algorithm",
+-- Cooper, Harvey, and Kennedy)
+local idom = {[ROOT] = ROOT}
+local function intersect (a, b)
+  while a ~= b do
+    while index[a] > index[b] do a = idom[a] end
+    while index[b] > index[a] do b = idom[b] end
+  end
+  return a
+end
+
+local changed = true
+while changed do
+  changed = false
+  for i = 2, #order do
+    local node = order[i]
+    local new
+    for _, p in ipairs(preds[node]) do
+      if idom[p] then
+        new = new and intersect(new, p) or p
+      end
+    end
+    if idom[node] ~= new then
+      idom[node] = new
+      changed = true
+    end
+  end
+end
+
+
+-- retained sizes: accumulate sizes bottom-up in the dominator tree
+local retained = {}
+for i = #order, 2, -1 do
+  local node = order[i]
+  retained[node] = (retained[node] or 0) + objs[node].size
+  local d = idom[node]
+  if d ~= ROOT then
+    retained[d] = (retained[d] or 0) + retained[node]
+  end
+end
+
+
+-- report
+local bytype, total, unreachable = {}, 0, 0
+for id, o in pairs(objs) do
+  local t = bytype[o.type] or {count = 0, size = 0}
+  bytype[o.type] = t
+  t.count = t.count + 1
+  t.size = t.size + o.size
+  total = total + o.size
+  if not index[id] then unreachable = unreachable + o.size end
+end
+
+local types = {}
+for name in pairs(bytype) do types[#types + 1] = name end
+table.sort(types, function (a, b) return bytype[a].size > bytype[b].size end)
+print(string.format("%-10s %10s %12s", "type", "count", "bytes"))
+for _, name in ipairs(types) do
+  print(string.format("%-10s %10d %12d", name, bytype[name].count,
+                      bytype[name].size))
+end
+print(string.format("%-10s %10s %12d", "total", "", total))
+print(string.format("%-10s %10s %12d", "unreachable", "", unreachable))
+
+local top = {}
+for i = 2, #order do top[#top + 1] = order[i] end
+table.sort(top, function (a, b) return retained[a] > retained[b] end)
+print()
+print(string.format("%-18s %-9s %10s %10s  %s", "object", "type", "size",
+                    "retained", "name"))
+for i = 1, math.min(ntop, #top) do
+  local id = top[i]
+  local o = objs[id]
+  print(string.format("%-18s %-9s %10d %10d  %s", id, o.type, o.size,
+                      retained[id], o.name or ""))
+end
@@ -0,0 +1,105 @@
+-- $Id: numfmt.lua $
+-- Differential check of the conversion of numbers to strings.
+-- 数字到字符串转换的差分检查
+-- See Copyright Notice in lua.h
+--
+-- usage: lua numfmt.lua [n [seed [digits]]]
+--
+-- Lua converts numbers to strings with its own code (see 'tostringbuff'
+-- in lobject.c), which must give the same results as the C library with
+-- LUA_INTEGER_FMT and LUA_NUMBER_FMT. This script compares 'tostring'
+-- with 'string.format' over 'n' (default 2000000) random floats and as
+-- many random integers. 'digits' (default 14) must be LUAI_NUMDIGITS.
+-- Run it again whenever those formats or the conversion code change.
+
+local N = math.tointeger(tonumber(arg[1])) or 2000000
+local seed = math.tointeger(tonumber(arg[2])) or os.time()
+local digits = math.tointeger(tonumber(arg[3])) or 14
+local fltfmt = "%." .. digits .. "g"
+
+math.randomseed(seed)
+local random = math.random
+local pack, unpack = string.pack, string.unpack
+
+local function frombits (b)
+  return (unpack("<d", pack("<i8", b)))
+end
+
+local function tobits (x)
+  return (unpack("<i8", pack("<d", x)))
+end
+
+
+-- generators of floats, each stressing a different part of the range
+local gens = {
+  -- any bit pattern (mostly in exponent form)
+  function () return frombits(random(0)) end,
+  -- magnitudes written without an exponent, log-uniform
+  function ()
+    return (random() + 1) * 10.0^random(-6, 15) * (random(2) * 2 - 3)
+  end,
+  -- short decimals
+  function () return random(-10^9, 10^9) / 10^random(0, 14) end,
+  -- halfway between two 'digits'-digit decimals (ties)
+  function ()
+    local n = random(10^(digits - 1), 10^digits - 1) * 10 + 5
+    return n / 10^random(0, digits + 4)
+  end,
+  -- integral values, mostly near 2^53 and 1e15
+  function ()
+    local r = random(3)
+    if r == 1 then return random(-2^53, 2^53) + 0.0
+    elseif r == 2 then return 1e15 + random(-1000, 1000)
+    else return 10.0^random(-5, 15)
+    end
+  end,
+}
+
+
+local function expected (x)
+  local s = string.format(fltfmt, x)
+  if s:find("^[-0-9]*$") then  -- looks like an int?
+    s = s .. ".0"
+  end
+  return s
+end
+
+
+local bad = 0
+local count = {float = 0, integer = 0}
+
+local function check (x, exp)
+  local got = tostring(x)
+  count[math.type(x)] = count[math.type(x)] + 1
+  if got ~= exp then
+    bad = bad + 1
+    if bad <= 10 then
+      print(string.format("mismatch for %a: got %s, expected %s",
+                          x, got, exp))
+    end
+  end
+end
+
+
+for i = 1, N do
+  local x = gens[i % #gens + 1]()
+  if x == x then  -- skip NaNs (their sign is not portable)
+    check(x, expected(x))
+    -- also its neighbors, which round differently near ties
+    local b = tobits(x)
+    local y = frombits(b + 1)
+    if y == y then check(y, expected(y)) end
+    y = frombits(b - 1)
+    if y == y then check(y, expected(y)) end
+  end
+  local n = random(0) >> random(0, 63)
+  if random(2) == 1 then n = -n end
+  check(n, string.format("%d", n))
+end
+check(math.mininteger, string.format("%d", math.mininteger))
+check(math.maxinteger, string.format("%d", math.maxinteger))
+
+print(string.format("numfmt: seed %d, %d floats and %d integers, "
+                    .. "%d mismatches",
+                    seed, count.float, count.integer, bad))
+if bad > 0 then os.exit(false) end
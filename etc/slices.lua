@@ -0,0 +1,80 @@
+-- $Id: slices.lua $
+-- Checks for substrings that share the contents of their parents.
+-- 共享父字符串内容的子串的检查
+-- See Copyright Notice in lua.h
+--
+-- usage: lua slices.lua
+--
+-- Long results of 'string.sub' are slices (see 'luaS_sub' in lstring.c).
+-- The string library reads a slice in place, while 'tostring' and other
+-- functions that need a final '\0' give it its own copy of its contents.
+-- These checks make a slice get that copy, and run collections, while a
+-- library function is still reading the slice's old contents. They are
+-- most useful in a build with address sanitizing.
+
+local function fullgc ()
+  collectgarbage()
+  collectgarbage()
+end
+
+local function clobber ()  -- reuse freed memory, if any
+  local t = {}
+  for i = 1, 20 do t[i] = string.rep(string.char(64 + i), 10000) end
+  return t
+end
+
+
+-- 'gsub' with a callback that copies the contents of its subject
+do
+  local s = string.rep("q", 10000):sub(1, 9000)
+  local r, n = s:gsub("q", function ()
+    tostring(s)
+    fullgc()
+    clobber()
+    return "q"
+  end)
+  assert(n == 9000 and r == string.rep("q", 9000))
+end
+
+
+-- 'gmatch' iterator living across copies and collections
+do
+  local s = string.rep("ab;", 4000):sub(1, 9000)
+  local n = 0
+  for w in s:gmatch("%a+") do
+    assert(w == "ab")
+    n = n + 1
+    if n % 100 == 0 then
+      tostring(s)
+      fullgc()
+      clobber()
+    end
+  end
+  assert(n == 3000)
+end
+
+
+-- 'find' and 'match' with a slice that is copied in between
+do
+  local s = string.rep("x;", 5000):sub(3, 9000)
+  for i = 1, 3 do
+    assert(s:find(";x;", 1, true) == 2)
+    assert(s:match("(x;)$") == "x;")
+    tostring(s)
+    fullgc()
+  end
+end
+
+
+-- a chain of slices of copied slices
+do
+  local s = string.rep("c;", 10000)
+  for i = 1, 2000 do
+    s = s:sub(1, -2)
+    tostring(s)
+  end
+  fullgc()
+  assert(#s == 18000 and s:sub(-2) == "c;")
+end
+
+print("slices: OK")
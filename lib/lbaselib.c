@@ -190,7 +190,8 @@ static int pushmode (lua_State *L, int oldmode) {
     luaL_pushfail(L);  /* invalid call to 'lua_gc' 对'lua_gc'的调用无效 */
   else
     lua_pushstring(L, (oldmode == LUA_GCINC) ? "incremental"
-                                             : "generational");
+                    : (oldmode == LUA_GCGEN) ? "generational"
+                                             : "adaptive");
   return 1;
 }
 
@@ -201,13 +202,48 @@ static int pushmode (lua_State *L, int oldmode) {
 */
 #define checkvalres(res) { if (res == -1) break; }
 
+/*
+** options "stats" and "types" do not go through 'lua_gc'
+** 选项 "stats" 和 "types" 不经过 'lua_gc'
+*/
+#define GCSTATS		(-1)
+#define GCTYPES		(-2)
+
+
+/*
+** push a table with the number of objects and bytes of each kind
+** 压入一个包含每种对象数量和字节数的表
+*/
+static int pushtypes (lua_State *L) {
+  static const char *const kinds[LUA_NUMGCKINDS] = {"table",
+    "shortstring", "longstring", "luaclosure", "cclosure", "userdata",
+    "thread", "proto", "upvalue"};
+  lua_GCTypes types;
+  int i;
+  lua_gctypes(L, &types);
+  lua_createtable(L, 0, LUA_NUMGCKINDS);
+  for (i = 0; i < LUA_NUMGCKINDS; i++) {
+    lua_createtable(L, 0, 2);
+    lua_pushinteger(L, (lua_Integer)types.count[i]);
+    lua_setfield(L, -2, "count");
+    lua_pushinteger(L, (lua_Integer)types.bytes[i]);
+    lua_setfield(L, -2, "bytes");
+    lua_setfield(L, -2, kinds[i]);
+  }
+  return 1;
+}
+
 static int luaB_collectgarbage (lua_State *L) {
   static const char *const opts[] = {"stop", "restart", "collect",
     "count", "step", "setpause", "setstepmul",
-    "isrunning", "generational", "incremental", NULL};
+    "isrunning", "generational", "incremental", "softlimit", "hardlimit",
+    "allocsample", "adaptive", "stats", "finbudget", "finalize",
+    "stepfor", "types", NULL};
   static const int optsnum[] = {LUA_GCSTOP, LUA_GCRESTART, LUA_GCCOLLECT,
     LUA_GCCOUNT, LUA_GCSTEP, LUA_GCSETPAUSE, LUA_GCSETSTEPMUL,
-    LUA_GCISRUNNING, LUA_GCGEN, LUA_GCINC};
+    LUA_GCISRUNNING, LUA_GCGEN, LUA_GCINC, LUA_GCSOFTLIMIT, LUA_GCHARDLIMIT,
+    LUA_GCALLOCSAMPLE, LUA_GCADAPTIVE, GCSTATS,
+    LUA_GCFINBUDGET, LUA_GCFINALIZE, LUA_GCSTEPUS, GCTYPES};
   int o = optsnum[luaL_checkoption(L, 1, "collect", opts)];
   switch (o) {
     case LUA_GCCOUNT: {
@@ -217,7 +253,8 @@ static int luaB_collectgarbage (lua_State *L) {
       lua_pushnumber(L, (lua_Number)k + ((lua_Number)b/1024));
       return 1;
     }
-    case LUA_GCSTEP: {
+    case LUA_GCSTEP:
+    case LUA_GCSTEPUS: {
       int step = (int)luaL_optinteger(L, 2, 0);
       int res = lua_gc(L, o, step);
       checkvalres(res);
@@ -225,13 +262,24 @@ static int luaB_collectgarbage (lua_State *L) {
       return 1;
     }
     case LUA_GCSETPAUSE:
-    case LUA_GCSETSTEPMUL: {
+    case LUA_GCSETSTEPMUL:
+    case LUA_GCFINALIZE: {
       int p = (int)luaL_optinteger(L, 2, 0);
       int previous = lua_gc(L, o, p);
       checkvalres(previous);
       lua_pushinteger(L, previous);
       return 1;
     }
+    case LUA_GCSOFTLIMIT:
+    case LUA_GCHARDLIMIT:
+    case LUA_GCALLOCSAMPLE:
+    case LUA_GCFINBUDGET: {
+      int limit = (int)luaL_optinteger(L, 2, -1);
+      int previous = lua_gc(L, o, limit);
+      checkvalres(previous);
+      lua_pushinteger(L, previous);
+      return 1;
+    }
     case LUA_GCISRUNNING: {
       int res = lua_gc(L, o);
       checkvalres(res);
@@ -243,6 +291,41 @@ static int luaB_collectgarbage (lua_State *L) {
       int majormul = (int)luaL_optinteger(L, 3, 0);
       return pushmode(L, lua_gc(L, o, minormul, majormul));
     }
+    case LUA_GCADAPTIVE: {
+      return pushmode(L, lua_gc(L, o));
+    }
+    case GCSTATS: {
+      lua_GCStats stats;
+      lua_gcstats(L, &stats);
+      lua_createtable(L, 0, 10);
+      lua_pushstring(L, (stats.mode == LUA_GCINC) ? "incremental"
+                                                  : "generational");
+      lua_setfield(L, -2, "mode");
+      lua_pushboolean(L, stats.adaptive);
+      lua_setfield(L, -2, "adaptive");
+      lua_pushinteger(L, (lua_Integer)stats.cycles);
+      lua_setfield(L, -2, "cycles");
+      lua_pushinteger(L, (lua_Integer)stats.minors);
+      lua_setfield(L, -2, "minors");
+      lua_pushinteger(L, (lua_Integer)stats.switches);
+      lua_setfield(L, -2, "switches");
+      lua_pushinteger(L, (lua_Integer)stats.finpending);
+      lua_setfield(L, -2, "finpending");
+      lua_pushinteger(L, (lua_Integer)stats.finalized);
+      lua_setfield(L, -2, "finalized");
+      lua_pushinteger(L, (lua_Integer)stats.largebytes);
+      lua_setfield(L, -2, "largebytes");
+      lua_pushinteger(L, (lua_Integer)stats.pretenured);
+      lua_setfield(L, -2, "pretenured");
+      if (stats.lastswitch != NULL) {
+        lua_pushstring(L, stats.lastswitch);
+        lua_setfield(L, -2, "lastswitch");
+      }
+      return 1;
+    }
+    case GCTYPES: {
+      return pushtypes(L);
+    }
     case LUA_GCINC: {
       int pause = (int)luaL_optinteger(L, 2, 0);
       int stepmul = (int)luaL_optinteger(L, 3, 0);
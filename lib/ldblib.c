@@ -453,6 +453,65 @@ static int db_traceback (lua_State *L) {
 }
 
 
+static int snapwriter (lua_State *L, const void *b, size_t size, void *f) {
+  (void)L;  /* not used */
+  return (fwrite(b, 1, size, (FILE *)f) != size);
+}
+
+
+/*
+** Get the output file for a dump, given either by its name or as an
+** open file handle. Returns NULL if the file cannot be opened.
+** 获取输出文件，文件可以由名称或已打开的文件句柄给出。
+*/
+static FILE *openoutput (lua_State *L, int *ishandle) {
+  luaL_Stream *p = (luaL_Stream *)luaL_testudata(L, 1, LUA_FILEHANDLE);
+  *ishandle = (p != NULL);
+  if (p != NULL) {  /* a file handle? */
+    luaL_argcheck(L, p->closef != NULL, 1, "attempt to use a closed file");
+    return p->f;
+  }
+  else
+    return fopen(luaL_checkstring(L, 1), "wb");
+}
+
+
+static int closeoutput (lua_State *L, FILE *f, int ishandle, int ok) {
+  ok = ishandle ? (fflush(f) == 0 && ok) : (fclose(f) == 0 && ok);
+  return luaL_fileresult(L, ok, NULL);
+}
+
+
+/*
+** Write a heap snapshot into a file.
+** 将堆快照写入文件。
+*/
+static int db_heapsnapshot (lua_State *L) {
+  int ishandle;
+  FILE *f = openoutput(L, &ishandle);
+  if (f == NULL)
+    return luaL_fileresult(L, 0, lua_tostring(L, 1));
+  return closeoutput(L, f, ishandle,
+                     lua_heapsnapshot(L, snapwriter, f) == 0);
+}
+
+
+/*
+** Write the allocation profile into a file, in pprof format, and
+** optionally discard the samples collected so far.
+** 将分配剖析以 pprof 格式写入文件，并可选择丢弃已收集的样本。
+*/
+static int db_allocprofile (lua_State *L) {
+  int ishandle;
+  int reset = lua_toboolean(L, 2);
+  FILE *f = openoutput(L, &ishandle);
+  if (f == NULL)
+    return luaL_fileresult(L, 0, lua_tostring(L, 1));
+  return closeoutput(L, f, ishandle,
+                     lua_allocprofile(L, snapwriter, f, reset) == 0);
+}
+
+
 static int db_setcstacklimit (lua_State *L) {
   int limit = (int)luaL_checkinteger(L, 1);
   int res = lua_setcstacklimit(L, limit);
@@ -462,9 +521,11 @@ static int db_setcstacklimit (lua_State *L) {
 
 
 static const luaL_Reg dblib[] = {
+  {"allocprofile", db_allocprofile}, // 分配剖析
   {"debug", db_debug}, // 调试
   {"getuservalue", db_getuservalue}, // 获得用户值
   {"gethook", db_gethook}, // 获得钩子
+  {"heapsnapshot", db_heapsnapshot}, // 堆快照
   {"getinfo", db_getinfo}, // 获得信息
   {"getlocal", db_getlocal}, // 获得本地
   {"getregistry", db_getregistry}, //获得注册表
@@ -685,7 +685,7 @@ static int g_write (lua_State *L, FILE *f, int arg) {
     }
     else {
       size_t l;
-      const char *s = luaL_checklstring(L, arg, &l);
+      const char *s = luaL_checklbytes(L, arg, &l);
       status = status && (fwrite(s, sizeof(char), l, f) == l);
     }
   }
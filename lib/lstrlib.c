@@ -54,7 +54,7 @@
 
 static int str_len (lua_State *L) {
   size_t l;
-  luaL_checklstring(L, 1, &l);
+  luaL_checklbytes(L, 1, &l);
   lua_pushinteger(L, (lua_Integer)l);
   return 1;
 }
@@ -99,11 +99,12 @@ static size_t getendpos (lua_State *L, int arg, lua_Integer def,
 
 static int str_sub (lua_State *L) {
   size_t l;
-  const char *s = luaL_checklstring(L, 1, &l);
-  size_t start = posrelatI(luaL_checkinteger(L, 2), l);
-  size_t end = getendpos(L, 3, -1, l);
-  if (start <= end)
-    lua_pushlstring(L, s + start - 1, (end - start) + 1);
+  size_t start, end;
+  luaL_checklbytes(L, 1, &l);
+  start = posrelatI(luaL_checkinteger(L, 2), l);
+  end = getendpos(L, 3, -1, l);
+  if (start <= end)  /* may share the contents of a long string */
+    lua_pushsubstring(L, 1, start - 1, (end - start) + 1);
   else lua_pushliteral(L, "");
   return 1;
 }
@@ -112,7 +113,7 @@ static int str_sub (lua_State *L) {
 static int str_reverse (lua_State *L) {
   size_t l, i;
   luaL_Buffer b;
-  const char *s = luaL_checklstring(L, 1, &l);
+  const char *s = luaL_checklbytes(L, 1, &l);
   char *p = luaL_buffinitsize(L, &b, l);
   for (i = 0; i < l; i++)
     p[i] = s[l - i - 1];
@@ -125,7 +126,7 @@ static int str_lower (lua_State *L) {
   size_t l;
   size_t i;
   luaL_Buffer b;
-  const char *s = luaL_checklstring(L, 1, &l);
+  const char *s = luaL_checklbytes(L, 1, &l);
   char *p = luaL_buffinitsize(L, &b, l);
   for (i=0; i<l; i++)
     p[i] = tolower(uchar(s[i]));
@@ -138,7 +139,7 @@ static int str_upper (lua_State *L) {
   size_t l;
   size_t i;
   luaL_Buffer b;
-  const char *s = luaL_checklstring(L, 1, &l);
+  const char *s = luaL_checklbytes(L, 1, &l);
   char *p = luaL_buffinitsize(L, &b, l);
   for (i=0; i<l; i++)
     p[i] = toupper(uchar(s[i]));
@@ -149,9 +150,9 @@ static int str_upper (lua_State *L) {
 
 static int str_rep (lua_State *L) {
   size_t l, lsep;
-  const char *s = luaL_checklstring(L, 1, &l);
+  const char *s = luaL_checklbytes(L, 1, &l);
   lua_Integer n = luaL_checkinteger(L, 2);
-  const char *sep = luaL_optlstring(L, 3, "", &lsep);
+  const char *sep = luaL_optlbytes(L, 3, "", &lsep);
   if (n <= 0)
     lua_pushliteral(L, "");
   else if (l_unlikely(l + lsep < l || l + lsep > MAXSIZE / n))
@@ -176,7 +177,7 @@ static int str_rep (lua_State *L) {
 
 static int str_byte (lua_State *L) {
   size_t l;
-  const char *s = luaL_checklstring(L, 1, &l);
+  const char *s = luaL_checklbytes(L, 1, &l);
   lua_Integer pi = luaL_optinteger(L, 2, 1);
   size_t posi = posrelatI(pi, l);
   size_t pose = getendpos(L, 3, pi, l);
@@ -357,8 +358,9 @@ static const luaL_Reg stringmetamethods[] = {
 
 typedef struct MatchState {
   const char *src_init;  /* init of source string */
-  const char *src_end;  /* end ('\0') of source string */
+  const char *src_end;  /* end of source string */
   const char *p_end;  /* end ('\0') of pattern */
+  const struct PatProg *pp;  /* compiled pattern (NULL if none) */
   lua_State *L;
   int matchdepth;  /* control for recursive depth (to avoid C stack overflow) */
   unsigned char level;  /* total number of captures (finished or unfinished) */
@@ -483,14 +485,9 @@ static int singlematch (MatchState *ms, const char *s, const char *p,
 }
 
 
-static const char *matchbalance (MatchState *ms, const char *s,
-                                   const char *p) {
-  if (l_unlikely(p >= ms->p_end - 1))
-    luaL_error(ms->L, "malformed pattern (missing arguments to '%%b')");
-  if (*s != *p) return NULL;
+static const char *balanced (MatchState *ms, const char *s, int b, int e) {
+  if (*s != b) return NULL;
   else {
-    int b = *p;
-    int e = *(p+1);
     int cont = 1;
     while (++s < ms->src_end) {
       if (*s == e) {
@@ -503,6 +500,14 @@ static const char *matchbalance (MatchState *ms, const char *s,
 }
 
 
+static const char *matchbalance (MatchState *ms, const char *s,
+                                   const char *p) {
+  if (l_unlikely(p >= ms->p_end - 1))
+    luaL_error(ms->L, "malformed pattern (missing arguments to '%%b')");
+  return balanced(ms, s, *p, *(p+1));
+}
+
+
 static const char *max_expand (MatchState *ms, const char *s,
                                  const char *p, const char *ep) {
   ptrdiff_t i = 0;  /* counts maximum expand for item */
@@ -600,14 +605,15 @@ static const char *match (MatchState *ms, const char *s, const char *p) {
             break;
           }
           case 'f': {  /* frontier? */
-            const char *ep; char previous;
+            const char *ep; char previous, current;
             p += 2;
             if (l_unlikely(*p != '['))
               luaL_error(ms->L, "missing '[' after '%%f' in pattern");
             ep = classend(ms, p);  /* points to what is next */
             previous = (s == ms->src_init) ? '\0' : *(s - 1);
+            current = (s < ms->src_end) ? *s : '\0';  /* may be a slice */
             if (!matchbracketclass(uchar(previous), p, ep - 1) &&
-               matchbracketclass(uchar(*s), p, ep - 1)) {
+               matchbracketclass(uchar(current), p, ep - 1)) {
               p = ep; goto init;  /* return match(ms, s, ep); */
             }
             s = NULL;  /* match failed */
@@ -670,27 +676,896 @@ static const char *match (MatchState *ms, const char *s, const char *p) {
 
 
 
+/*
+** {======================================================
+** Substring search
+** 'lmemfind' filters candidate positions with two chars of the needle
+** (16 positions at a time, with SSE2) and compares the rest. If these
+** comparisons cost too much, which happens only with repetitive
+** strings, it finishes the search with the two-way algorithm, whose
+** time is linear.
+** 子串搜索：先用needle中的两个字符筛选候选位置（SSE2一次16个），再比较其余部分；
+** 比较代价过高时（重复性字符串）改用线性时间的双向算法。
+** =======================================================
+*/
+
+#if defined(__SSE2__) && !defined(LUA_USE_C89)
+#define L_SSE2
+#include <emmintrin.h>
+#endif
+
+
+/*
+** Maximal suffix of needle 'n' for the order given by 'rev' (plain or
+** reversed); returns its start minus one and its period in '*period'.
+*/
+static size_t maxsuffix (const unsigned char *n, size_t l, int rev,
+                         size_t *period) {
+  size_t ip = (size_t)-1;  /* start of the suffix, minus one */
+  size_t jp = 0;  /* start of the candidate suffix */
+  size_t k = 1, p = 1;
+  while (jp + k < l) {
+    unsigned char a = n[ip + k], b = n[jp + k];
+    if (a == b) {
+      if (k == p) {
+        jp += p;
+        k = 1;
+      }
+      else k++;
+    }
+    else if (rev ? (a < b) : (a > b)) {
+      jp += k;
+      k = 1;
+      p = jp - ip;
+    }
+    else {
+      ip = jp++;
+      k = p = 1;
+    }
+  }
+  *period = p;
+  return ip;
+}
+
+
+/*
+** Two-way string matching (Crochemore-Perrin): search for 's2' in 's1'
+** in linear time and constant space.
+*/
+static const char *twowayfind (const char *s1, size_t l1,
+                               const char *s2, size_t l2) {
+  const unsigned char *h = (const unsigned char *)s1;
+  const unsigned char *n = (const unsigned char *)s2;
+  size_t ms, ms2, p, p2, mem0, mem = 0, pos = 0, k;
+  ms = maxsuffix(n, l2, 0, &p);
+  ms2 = maxsuffix(n, l2, 1, &p2);
+  if (ms2 + 1 > ms + 1) {  /* use the later critical factorization */
+    ms = ms2; p = p2;
+  }
+  if (memcmp(n, n + p, ms + 1) != 0) {  /* needle is not periodic? */
+    p = ((ms + 1 > l2 - ms - 1) ? ms + 1 : l2 - ms - 1) + 1;
+    mem0 = 0;
+  }
+  else
+    mem0 = l2 - p;  /* prefix known to match after a shift by 'p' */
+  while (pos + l2 <= l1) {
+    /* compare right half */
+    for (k = (ms + 1 > mem) ? ms + 1 : mem; k < l2 && n[k] == h[pos + k];)
+      k++;
+    if (k < l2) {
+      pos += k - ms;
+      mem = 0;
+      continue;
+    }
+    /* compare left half */
+    for (k = ms + 1; k > mem && n[k - 1] == h[pos + k - 1];)
+      k--;
+    if (k <= mem)
+      return s1 + pos;
+    pos += p;
+    mem = mem0;
+  }
+  return NULL;  /* not found */
+}
+
+
+/*
+** Search for 's2' ('1 < l2 <= l1') with 'memchr' on its first char.
+** Each failed comparison costs 'l2' from '*work'; when it runs out,
+** the search goes on with 'twowayfind'.
+*/
+static const char *simplefind (const char *s1, size_t l1,
+                               const char *s2, size_t l2, size_t *work) {
+  const char *e = s1 + l1;  /* end of 's1' */
+  const char *last = e - l2;  /* last place where 's2' can start */
+  const char *init;  /* to search for a '*s2' inside 's1' */
+  while (s1 <= last &&
+         (init = (const char *)memchr(s1, *s2, last - s1 + 1)) != NULL) {
+    if (memcmp(init + 1, s2 + 1, l2 - 1) == 0)
+      return init;
+    else if (*work < l2)  /* too much work? */
+      return twowayfind(init + 1, e - (init + 1), s2, l2);
+    *work -= l2;
+    s1 = init + 1;  /* try again after this position */
+  }
+  return NULL;  /* not found */
+}
+
+
 static const char *lmemfind (const char *s1, size_t l1,
                                const char *s2, size_t l2) {
+  size_t work = 4 * l1 + 256;  /* allowed cost for failed comparisons */
   if (l2 == 0) return s1;  /* empty strings are everywhere */
   else if (l2 > l1) return NULL;  /* avoids a negative 'l1' */
+  else if (l2 == 1) return (const char *)memchr(s1, *s2, l1);
+#if defined(L_SSE2)
   else {
-    const char *init;  /* to search for a '*s2' inside 's1' */
-    l2--;  /* 1st char will be checked by 'memchr' */
-    l1 = l1-l2;  /* 's2' cannot be found after that */
-    while (l1 > 0 && (init = (const char *)memchr(s1, *s2, l1)) != NULL) {
-      init++;   /* 1st char is already checked */
-      if (memcmp(init, s2+1, l2) == 0)
-        return init-1;
-      else {  /* correct 'l1' and 's1' to try again */
-        l1 -= init-s1;
-        s1 = init;
+    /* filter with the first char and the last one that differs from it */
+    size_t k = l2 - 1;
+    size_t i = 0;
+    __m128i vf, vk;
+    while (k > 0 && s2[k] == s2[0]) k--;
+    if (k == 0) k = l2 - 1;  /* all chars are equal */
+    vf = _mm_set1_epi8(s2[0]);
+    vk = _mm_set1_epi8(s2[k]);
+    for (; i + k + 16 <= l1; i += 16) {
+      __m128i a = _mm_loadu_si128((const __m128i *)(s1 + i));
+      __m128i b = _mm_loadu_si128((const __m128i *)(s1 + i + k));
+      unsigned int mask = (unsigned int)_mm_movemask_epi8(
+                  _mm_and_si128(_mm_cmpeq_epi8(a, vf), _mm_cmpeq_epi8(b, vk)));
+      while (mask != 0) {
+        size_t j = i + __builtin_ctz(mask);
+        if (j + l2 > l1)
+          return NULL;  /* no room for 's2' from here on */
+        if (memcmp(s1 + j + 1, s2 + 1, l2 - 1) == 0)
+          return s1 + j;
+        else if (work < l2)  /* too much work? */
+          return twowayfind(s1 + j + 1, l1 - (j + 1), s2, l2);
+        work -= l2;
+        mask &= mask - 1;  /* next candidate */
       }
     }
-    return NULL;  /* not found */
+    if (l1 - i < l2)
+      return NULL;
+    return simplefind(s1 + i, l1 - i, s2, l2, &work);  /* the rest */
   }
+#else
+  else
+    return simplefind(s1, l1, s2, l2, &work);
+#endif
 }
 
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Compiled patterns
+** A pattern used a second time is compiled into a program, an array of
+** items where each single-char class became a bitmap, consecutive
+** plain characters became one literal, and the matcher then runs that
+** program. The analysis of its first item also gives a literal prefix
+** or a set of first characters, which let a search skip over positions
+** where no match can start. Malformed patterns are not compiled, so
+** that the interpreter still raises their errors only when it gets to
+** them. The programs are kept in a per-state cache (see 'getprog').
+** 使用第二次的模式会被编译为程序：每个单字符类变成位图，连续的普通字符
+** 合并为一个字面串；搜索可以借助字面前缀或首字符集合跳过不可能匹配的位置。
+** =======================================================
+*/
+
+/* item opcodes */
+enum {
+  PI_END,  /* end of program */
+  PI_LITERAL,  /* plain characters (pattern text 'p'..'ep') */
+  PI_CHAR,  /* single character 'c1' with a suffix */
+  PI_ANY,  /* '.' */
+  PI_SET,  /* character class in 'set' */
+  PI_OPEN,  /* '(' */
+  PI_POSITION,  /* '()' */
+  PI_CLOSE,  /* ')' */
+  PI_BALANCE,  /* '%b' with delimiters 'c1' and 'c2' */
+  PI_FRONTIER,  /* '%f' with class in 'set' */
+  PI_BACKREF,  /* '%0'-'%9' with digit 'c1' */
+  PI_EOS  /* final '$' */
+};
+
+
+#define SETBYTES	((UCHAR_MAX + 1) / CHAR_BIT)
+
+/* maximum number of ranges in a class for the vector scans */
+#define MAXRANGES	4
+
+#define inset(set,c)	((set)[(c) / CHAR_BIT] & (1u << ((c) % CHAR_BIT)))
+#define addset(set,c)	((set)[(c) / CHAR_BIT] |= (1u << ((c) % CHAR_BIT)))
+
+
+typedef struct PatItem {
+  unsigned char op;  /* opcode (PI_*) */
+  unsigned char rep;  /* suffix ('*', '+', '-', '?') or 0 */
+  unsigned char lochi;  /* test chars above 127 with the pattern text? */
+  unsigned char c1, c2;  /* arguments (see opcodes) */
+  unsigned char nrange;  /* number of ranges in the class (0 if unknown) */
+  unsigned char negrange;  /* ranges are of chars out of the class? */
+  unsigned char lo[MAXRANGES], hi[MAXRANGES];  /* class as ranges */
+  size_t p, ep;  /* item text in the pattern (offsets) */
+  unsigned char set[SETBYTES];  /* bitmap for classes */
+} PatItem;
+
+
+typedef struct PatProg {
+  const char *pat;  /* pattern text (after a '^') */
+  int n;  /* number of items (-1 if pattern was not compiled) */
+  int anchor;  /* pattern starts with '^'? */
+  size_t prefix, lprefix;  /* literal where any match starts (offset) */
+  int first;  /* item that any match starts with (-1 if none) */
+  PatItem code[1];
+} PatProg;
+
+
+/*
+** Classes that depend on the locale. Their bitmaps keep only the ASCII
+** part (which locales do not change), and the other chars are checked
+** with the pattern text whenever they occur.
+*/
+static int islocclass (int cl) {
+  return strchr("acglpsuw", tolower(cl)) != NULL && cl != 0;
+}
+
+
+static int setmatch (const PatProg *pp, const PatItem *it, int c) {
+  if (c <= 0x7F || !it->lochi)
+    return inset(it->set, c);
+  else {
+    const char *p = pp->pat + it->p;
+    if (*p == L_ESC)
+      return match_class(c, uchar(*(p + 1)));
+    else
+      return matchbracketclass(c, p, pp->pat + it->ep - 1);
+  }
+}
+
+
+/* whether char 'c' matches the class of item 'it' */
+static int itemmatch (const PatProg *pp, const PatItem *it, int c) {
+  switch (it->op) {
+    case PI_CHAR: return (c == it->c1);
+    case PI_ANY: return 1;
+    default: lua_assert(it->op == PI_SET); return setmatch(pp, it, c);
+  }
+}
+
+
+/*
+** Like 'classend', but returns NULL for a malformed class instead of
+** raising an error.
+*/
+static const char *classlimit (const char *p, const char *pend) {
+  switch (*p++) {
+    case L_ESC: {
+      return (p == pend) ? NULL : p + 1;
+    }
+    case '[': {
+      if (*p == '^') p++;
+      do {  /* look for a ']' */
+        if (p == pend)
+          return NULL;
+        if (*(p++) == L_ESC && p < pend)
+          p++;  /* skip escapes (e.g. '%]') */
+      } while (*p != ']');
+      return p + 1;
+    }
+    default: {
+      return p;
+    }
+  }
+}
+
+
+/*
+** Fill the bitmap of item 'it' with the class 'p'..'ep' (a '%x' escape
+** or a '[...]' set).
+*/
+static void compileset (PatItem *it, const char *p, const char *ep) {
+  int c;
+  memset(it->set, 0, SETBYTES);
+  for (c = 0; c <= UCHAR_MAX; c++) {
+    if ((*p == L_ESC) ? match_class(c, uchar(*(p + 1)))
+                      : matchbracketclass(c, p, ep - 1))
+      addset(it->set, c);
+  }
+  it->lochi = 0;
+  if (*p == L_ESC)
+    it->lochi = islocclass(uchar(*(p + 1)));
+  else {  /* look for locale classes inside the set */
+    const char *q = p;
+    if (*(q + 1) == '^') q++;
+    while (++q < ep - 1) {
+      if (*q == L_ESC && islocclass(uchar(*++q)))
+        it->lochi = 1;
+    }
+  }
+}
+
+
+/*
+** If the class in 'it' has exactly one char (e.g. '%.' or '[x]'),
+** return it; otherwise return -1.
+*/
+static int singlechar (const PatItem *it) {
+  int c, res = -1;
+  if (it->lochi)
+    return -1;
+  for (c = 0; c <= UCHAR_MAX; c++) {
+    if (inset(it->set, c)) {
+      if (res >= 0) return -1;  /* more than one */
+      res = c;
+    }
+  }
+  return res;
+}
+
+
+/*
+** Describe the class of item 'it' with at most MAXRANGES ranges of
+** chars in it or, failing that, of chars out of it, for the vector
+** scans. For locale classes, only the ASCII part is described.
+*/
+static void setranges (PatItem *it) {
+  int top = it->lochi ? 0x7F : UCHAR_MAX;
+  int neg;
+  for (neg = 0; neg <= 1; neg++) {
+    int n = 0;
+    int c;
+    for (c = 0; c <= top; c++) {
+      if ((inset(it->set, c) != 0) != neg) {  /* start of a range? */
+        if (n == MAXRANGES) break;  /* too many ranges */
+        it->lo[n] = (unsigned char)c;
+        while (c < top && (inset(it->set, c + 1) != 0) != neg)
+          c++;
+        it->hi[n++] = (unsigned char)c;
+      }
+    }
+    if (c > top) {  /* described the whole class? */
+      it->nrange = (unsigned char)n;
+      it->negrange = (unsigned char)neg;
+      if (n > 0) return;
+    }
+  }
+  it->nrange = 0;  /* no vector scans for this class */
+}
+
+
+/*
+** Compile pattern 'p' (without its '^') into 'code', or only count its
+** items when 'code' is NULL. It follows the same steps as 'match'.
+** Returns the number of items (including the final PI_END) or -1 if
+** the pattern is malformed.
+*/
+static int compilepat (PatItem *code, const char *p, size_t lp) {
+  const char *p0 = p;
+  const char *pend = p + lp;
+  const char *litend = NULL;  /* end of a literal that may grow */
+  int n = 0;
+  PatItem it;
+  while (p < pend) {
+    memset(&it, 0, offsetof(PatItem, set));
+    it.p = p - p0;
+    switch (*p) {
+      case '(': {
+        it.op = (*(p + 1) == ')') ? PI_POSITION : PI_OPEN;
+        p += (it.op == PI_POSITION) ? 2 : 1;
+        break;
+      }
+      case ')': {
+        it.op = PI_CLOSE; p++;
+        break;
+      }
+      case '$': {
+        if (p + 1 != pend)  /* not the last char in pattern? */
+          goto dflt;
+        it.op = PI_EOS; p++;
+        break;
+      }
+      case L_ESC: {
+        switch (*(p + 1)) {
+          case 'b': {
+            if (p + 3 >= pend) return -1;  /* missing arguments */
+            it.op = PI_BALANCE;
+            it.c1 = uchar(*(p + 2)); it.c2 = uchar(*(p + 3));
+            p += 4;
+            break;
+          }
+          case 'f': {
+            const char *ep;
+            p += 2;
+            if (*p != '[' || (ep = classlimit(p, pend)) == NULL)
+              return -1;
+            it.op = PI_FRONTIER;
+            it.p = p - p0; it.ep = ep - p0;
+            compileset(&it, p, ep);
+            p = ep;
+            break;
+          }
+          case '0': case '1': case '2': case '3':
+          case '4': case '5': case '6': case '7':
+          case '8': case '9': {
+            it.op = PI_BACKREF; it.c1 = uchar(*(p + 1));
+            p += 2;
+            break;
+          }
+          default: goto dflt;
+        }
+        break;
+      }
+      default: dflt: {  /* pattern class plus optional suffix */
+        const char *ep = classlimit(p, pend);
+        if (ep == NULL) return -1;
+        it.ep = ep - p0;
+        if (ep < pend &&
+            (*ep == '*' || *ep == '+' || *ep == '-' || *ep == '?'))
+          it.rep = uchar(*ep);
+        if (*p == '.')
+          it.op = PI_ANY;
+        else if (*p == L_ESC || *p == '[') {
+          int c;
+          it.op = PI_SET;
+          compileset(&it, p, ep);
+          if ((c = singlechar(&it)) >= 0) {  /* e.g. '%.' or '[x]' */
+            it.op = PI_CHAR; it.c1 = (unsigned char)c;
+          }
+        }
+        else if (it.rep != 0) {
+          it.op = PI_CHAR; it.c1 = uchar(*p);
+        }
+        else if (litend == p) {  /* plain char right after a literal? */
+          if (code != NULL)
+            code[n - 1].ep = it.ep;  /* extend that literal */
+          p = litend = ep;
+          continue;
+        }
+        else
+          it.op = PI_LITERAL;
+        if (it.op == PI_SET)
+          setranges(&it);
+        else if (it.op == PI_CHAR) {
+          it.nrange = 1;
+          it.lo[0] = it.hi[0] = it.c1;
+        }
+        p = (it.rep != 0) ? ep + 1 : ep;
+        break;
+      }
+    }
+    litend = (it.op == PI_LITERAL) ? p : NULL;
+    if (code != NULL) code[n] = it;
+    n++;
+  }
+  if (code != NULL) {
+    memset(&code[n], 0, offsetof(PatItem, set));
+    code[n].op = PI_END;
+  }
+  return n + 1;
+}
+
+
+/*
+** Find where any match of 'pp' must start: a literal prefix or a set
+** of first chars, when the first item (after opening captures) must
+** consume a char. Does not look past more than LUA_MAXCAPTURES open
+** captures, whose errors must happen at the first try.
+*/
+static void analyzeprog (PatProg *pp) {
+  const PatItem *it = pp->code;
+  pp->first = -1;
+  while ((it->op == PI_OPEN || it->op == PI_POSITION) &&
+         it - pp->code < LUA_MAXCAPTURES)
+    it++;
+  switch (it->op) {
+    case PI_LITERAL: {
+      pp->prefix = it->p;
+      pp->lprefix = it->ep - it->p;
+      break;
+    }
+    case PI_BALANCE: {  /* match must start with the opening delimiter */
+      pp->prefix = it->p + 2;
+      pp->lprefix = 1;
+      break;
+    }
+    case PI_CHAR: case PI_SET: {
+      if (it->rep == 0 || it->rep == '+')  /* must match a char? */
+        pp->first = (int)(it - pp->code);
+      break;
+    }
+    default: break;
+  }
+}
+
+
+/* skip chars in 'q'..'qe' whose matching of 'it' is 'want' */
+static const char *spanscalar (const PatProg *pp, const PatItem *it,
+                               const char *q, const char *qe, int want) {
+  if (it->op == PI_CHAR) {
+    for (; q < qe; q++) {
+      if ((uchar(*q) == it->c1) != want) break;
+    }
+  }
+  else {
+    lua_assert(it->op == PI_SET);
+    for (; q < qe; q++) {
+      if ((setmatch(pp, it, uchar(*q)) != 0) != want) break;
+    }
+  }
+  return q;
+}
+
+
+/*
+** Same as 'spanscalar', but with SSE2 a class described by ranges is
+** tested 16 chars at a time; a locale class checks its chars above 127
+** one by one.
+*/
+static const char *spanvector (const PatProg *pp, const PatItem *it,
+                               const char *q, const char *e, int want) {
+#if defined(L_SSE2)
+  if (it->nrange > 0) {
+    __m128i lo[MAXRANGES], d[MAXRANGES];
+    int n = it->nrange;
+    int i;
+    for (i = 0; i < n; i++) {
+      lo[i] = _mm_set1_epi8((char)it->lo[i]);
+      d[i] = _mm_set1_epi8((char)(it->hi[i] - it->lo[i]));
+    }
+    while (e - q >= 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)q);
+      __m128i in = _mm_setzero_si128();
+      unsigned int mask;
+      if (it->lochi && _mm_movemask_epi8(v) != 0) {
+        const char *ce = q + 16;  /* chars above 127: go one by one */
+        q = spanscalar(pp, it, q, ce, want);
+        if (q < ce) return q;
+        continue;
+      }
+      for (i = 0; i < n; i++) {  /* (c - lo) <= (hi - lo), unsigned */
+        __m128i t = _mm_sub_epi8(v, lo[i]);
+        in = _mm_or_si128(in, _mm_cmpeq_epi8(_mm_max_epu8(t, d[i]), d[i]));
+      }
+      mask = (unsigned int)_mm_movemask_epi8(in);  /* chars in ranges */
+      if ((it->negrange != 0) != want)
+        mask = ~mask;  /* chars where to stop */
+      mask &= 0xFFFF;
+      if (mask != 0)
+        return q + __builtin_ctz(mask);
+      q += 16;
+    }
+  }
+#endif
+  return spanscalar(pp, it, q, e, want);
+}
+
+
+/*
+** Skip the chars from 'q' whose matching of item 'it' is 'want', and
+** return the first position where it differs ('e' if none). Short
+** spans are common, so the first chars go one by one.
+*/
+static const char *spanclass (const PatProg *pp, const PatItem *it,
+                              const char *q, const char *e, int want) {
+  const char *qe = (e - q > 8) ? q + 8 : e;
+  q = spanscalar(pp, it, q, qe, want);
+  if (q < qe || q == e)  /* span ended? */
+    return q;
+  else
+    return spanvector(pp, it, q, e, want);
+}
+
+
+/*
+** Return the first position in 's'..'e' where a match of 'pp' may
+** start, or NULL if there is none.
+*/
+static const char *skipto (const PatProg *pp, const char *s,
+                                              const char *e) {
+  if (pp->lprefix > 0)
+    return lmemfind(s, e - s, pp->pat + pp->prefix, pp->lprefix);
+  else if (pp->first >= 0) {
+    s = spanclass(pp, &pp->code[pp->first], s, e, 0);
+    return (s < e) ? s : NULL;
+  }
+  else
+    return s;
+}
+
+
+/* recursive function */
+static const char *cmatch (MatchState *ms, const char *s,
+                           const PatItem *it);
+
+
+/*
+** Whether a match of item 'it' can start at 's'; this only avoids calls
+** to 'cmatch' that would fail right away.
+*/
+static int canstart (MatchState *ms, const char *s, const PatItem *it) {
+  switch (it->op) {
+    case PI_LITERAL:
+      return (s < ms->src_end && *s == ms->pp->pat[it->p]);
+    case PI_CHAR:
+      return (it->rep == 0 || it->rep == '+') ?
+             (s < ms->src_end && uchar(*s) == it->c1) : 1;
+    default: return 1;
+  }
+}
+
+
+/* number of consecutive chars from 's' that match item 'it' */
+static ptrdiff_t countmatches (MatchState *ms, const char *s,
+                               const PatItem *it) {
+  if (it->op == PI_ANY)
+    return ms->src_end - s;
+  else
+    return spanclass(ms->pp, it, s, ms->src_end, 1) - s;
+}
+
+
+static const char *cmax_expand (MatchState *ms, const char *s,
+                                const PatItem *it) {
+  ptrdiff_t i = countmatches(ms, s, it);
+  /* keeps trying to match with the maximum repetitions */
+  while (i>=0) {
+    if (canstart(ms, s + i, it + 1)) {
+      const char *res = cmatch(ms, s + i, it + 1);
+      if (res) return res;
+    }
+    i--;  /* else didn't match; reduce 1 repetition to try again */
+  }
+  return NULL;
+}
+
+
+static const char *cmin_expand (MatchState *ms, const char *s,
+                                const PatItem *it) {
+  const PatItem *next = it + 1;
+  if (it->op == PI_ANY &&
+      (next->op == PI_LITERAL || (next->op == PI_CHAR && next->rep == 0))) {
+    /* next item starts with a known char: jump to its occurrences */
+    int c = (next->op == PI_CHAR) ? next->c1 : uchar(ms->pp->pat[next->p]);
+    while ((s = (const char *)memchr(s, c, ms->src_end - s)) != NULL) {
+      const char *res = cmatch(ms, s, next);
+      if (res != NULL)
+        return res;
+      s++;
+    }
+    return NULL;
+  }
+  for (;;) {
+    if (canstart(ms, s, next)) {
+      const char *res = cmatch(ms, s, next);
+      if (res != NULL)
+        return res;
+    }
+    if (s < ms->src_end && itemmatch(ms->pp, it, uchar(*s)))
+      s++;  /* try with one more repetition */
+    else return NULL;
+  }
+}
+
+
+static const char *cstart_capture (MatchState *ms, const char *s,
+                                   const PatItem *it, int what) {
+  const char *res;
+  int level = ms->level;
+  if (level >= LUA_MAXCAPTURES) luaL_error(ms->L, "too many captures");
+  ms->capture[level].init = s;
+  ms->capture[level].len = what;
+  ms->level = level+1;
+  if ((res=cmatch(ms, s, it)) == NULL)  /* match failed? */
+    ms->level--;  /* undo capture */
+  return res;
+}
+
+
+static const char *cend_capture (MatchState *ms, const char *s,
+                                 const PatItem *it) {
+  int l = capture_to_close(ms);
+  const char *res;
+  ms->capture[l].len = s - ms->capture[l].init;  /* close capture */
+  if ((res = cmatch(ms, s, it)) == NULL)  /* match failed? */
+    ms->capture[l].len = CAP_UNFINISHED;  /* undo capture */
+  return res;
+}
+
+
+/*
+** Same as 'match', over a compiled pattern.
+*/
+static const char *cmatch (MatchState *ms, const char *s,
+                           const PatItem *it) {
+  if (l_unlikely(ms->matchdepth-- == 0))
+    luaL_error(ms->L, "pattern too complex");
+  init: /* using goto's to optimize tail recursion */
+  switch (it->op) {
+    case PI_END: break;
+    case PI_LITERAL: {
+      size_t l = it->ep - it->p;
+      if ((size_t)(ms->src_end - s) >= l &&
+          memcmp(s, ms->pp->pat + it->p, l) == 0) {
+        s += l; it++; goto init;
+      }
+      s = NULL;  /* fail */
+      break;
+    }
+    case PI_OPEN: {
+      s = cstart_capture(ms, s, it + 1, CAP_UNFINISHED);
+      break;
+    }
+    case PI_POSITION: {
+      s = cstart_capture(ms, s, it + 1, CAP_POSITION);
+      break;
+    }
+    case PI_CLOSE: {
+      s = cend_capture(ms, s, it + 1);
+      break;
+    }
+    case PI_EOS: {
+      s = (s == ms->src_end) ? s : NULL;  /* check end of string */
+      break;
+    }
+    case PI_BALANCE: {
+      s = balanced(ms, s, (char)it->c1, (char)it->c2);
+      if (s != NULL) {
+        it++; goto init;
+      }
+      break;
+    }
+    case PI_FRONTIER: {
+      int previous = (s == ms->src_init) ? '\0' : uchar(*(s - 1));
+      int current = (s < ms->src_end) ? uchar(*s) : '\0';
+      if (!setmatch(ms->pp, it, previous) &&
+          setmatch(ms->pp, it, current)) {
+        it++; goto init;
+      }
+      s = NULL;  /* match failed */
+      break;
+    }
+    case PI_BACKREF: {
+      s = match_capture(ms, s, it->c1);
+      if (s != NULL) {
+        it++; goto init;
+      }
+      break;
+    }
+    default: {  /* single char class plus optional suffix */
+      if (!(s < ms->src_end && itemmatch(ms->pp, it, uchar(*s)))) {
+        if (it->rep == '*' || it->rep == '?' || it->rep == '-') {
+          it++; goto init;  /* accept empty */
+        }
+        else  /* '+' or no suffix */
+          s = NULL;  /* fail */
+      }
+      else {  /* matched once */
+        switch (it->rep) {  /* handle optional suffix */
+          case '?': {  /* optional */
+            const char *res;
+            if ((res = cmatch(ms, s + 1, it + 1)) != NULL)
+              s = res;
+            else {
+              it++; goto init;
+            }
+            break;
+          }
+          case '+':  /* 1 or more repetitions */
+            s++;  /* 1 match already done */
+            /* FALLTHROUGH */
+          case '*':  /* 0 or more repetitions */
+            s = cmax_expand(ms, s, it);
+            break;
+          case '-':  /* 0 or more repetitions (minimum) */
+            s = cmin_expand(ms, s, it);
+            break;
+          default:  /* no suffix */
+            s++; it++; goto init;
+        }
+      }
+      break;
+    }
+  }
+  ms->matchdepth++;
+  return s;
+}
+
+
+/*
+** Size of the per-state cache of compiled patterns (a power of 2). It
+** is a full userdata, the first upvalue of the library functions, and
+** its user value is a table that keeps alive, for each slot 'i', its
+** pattern (at 'i + 1') and program (at 'PATCACHESIZE + i + 1'). Slots
+** are indexed by the address of the pattern contents, which is the
+** same for equal short strings (they are internalized); as different
+** strings may share their contents (slices and external strings), a
+** slot matches only a pattern equal to the string it keeps. A pattern
+** gets its program the second time it is seen, so that patterns used
+** only once do not pay for their compilation.
+*/
+#if !defined(PATCACHESIZE)
+#define PATCACHESIZE	64
+#endif
+
+typedef struct PatCache {
+  const char *key[PATCACHESIZE];  /* pattern in each slot */
+  const PatProg *prog[PATCACHESIZE];  /* its program (NULL if none yet) */
+} PatCache;
+
+
+static void newpatcache (lua_State *L) {
+  PatCache *pc = (PatCache *)lua_newuserdatauv(L, sizeof(PatCache), 1);
+  memset(pc, 0, sizeof(PatCache));
+  lua_createtable(L, 2 * PATCACHESIZE, 0);
+  lua_setiuservalue(L, -2, 1);
+}
+
+
+/*
+** Create (and push) the program for pattern 'p'.
+*/
+static const PatProg *newprog (lua_State *L, const char *p, size_t lp) {
+  int anchor = (*p == '^');
+  int n;
+  PatProg *pp;
+  if (anchor) {
+    p++; lp--;  /* skip anchor character */
+  }
+  n = compilepat(NULL, p, lp);
+  pp = (PatProg *)lua_newuserdatauv(L, offsetof(PatProg, code) +
+                                    ((n > 0) ? n : 0) * sizeof(PatItem), 0);
+  memset(pp, 0, offsetof(PatProg, code));
+  pp->pat = p;
+  pp->n = n;
+  pp->anchor = anchor;
+  if (n > 0) {
+    compilepat(pp->code, p, lp);
+    analyzeprog(pp);
+  }
+  return pp;
+}
+
+
+/*
+** Push the program for pattern 'p' (at stack index 'arg') and return
+** it, or push nil and return NULL if there is no program for it.
+*/
+static const PatProg *getprog (lua_State *L, int arg,
+                               const char *p, size_t lp) {
+  PatCache *pc = (PatCache *)lua_touserdata(L, lua_upvalueindex(1));
+  unsigned int i = (unsigned int)(((size_t)p >> 4) ^ ((size_t)p >> 12)) &
+                   (PATCACHESIZE - 1);
+  const PatProg *pp;
+  lua_getiuservalue(L, lua_upvalueindex(1), 1);  /* slots' contents */
+  lua_rawgeti(L, -1, i + 1);  /* pattern in the slot */
+  if (pc->key[i] != p || !lua_rawequal(L, -1, arg)) {  /* new pattern? */
+    lua_pop(L, 1);
+    lua_pushvalue(L, arg);
+    lua_rawseti(L, -2, i + 1);  /* keep pattern (and its address) */
+    lua_pushnil(L);
+    lua_rawseti(L, -2, PATCACHESIZE + i + 1);  /* release old program */
+    pc->key[i] = p;
+    pc->prog[i] = NULL;
+    lua_pop(L, 1);
+    lua_pushnil(L);
+    return NULL;
+  }
+  lua_pop(L, 1);
+  if (pc->prog[i] == NULL) {  /* second time: compile it */
+    pc->prog[i] = newprog(L, p, lp);
+    lua_rawseti(L, -2, PATCACHESIZE + i + 1);
+  }
+  lua_rawgeti(L, -1, PATCACHESIZE + i + 1);
+  lua_remove(L, -2);
+  pp = pc->prog[i];
+  return (pp->n > 0) ? pp : NULL;
+}
+
+/* }====================================================== */
+
 
 /*
 ** get information about the i-th capture. If there are no captures
@@ -761,6 +1636,7 @@ static void prepstate (MatchState *ms, lua_State *L,
   ms->src_init = s;
   ms->src_end = s + ls;
   ms->p_end = p + lp;
+  ms->pp = NULL;
 }
 
 
@@ -770,9 +1646,18 @@ static void reprepstate (MatchState *ms) {
 }
 
 
+/* match at 's', with the compiled pattern when there is one */
+static const char *domatch (MatchState *ms, const char *s, const char *p) {
+  if (ms->pp != NULL)
+    return cmatch(ms, s, ms->pp->code);
+  else
+    return match(ms, s, p);
+}
+
+
 static int str_find_aux (lua_State *L, int find) {
   size_t ls, lp;
-  const char *s = luaL_checklstring(L, 1, &ls);
+  const char *s = luaL_checklbytes(L, 1, &ls);
   const char *p = luaL_checklstring(L, 2, &lp);
   size_t init = posrelatI(luaL_optinteger(L, 3, 1), ls) - 1;
   if (init > ls) {  /* start after string's end? */
@@ -792,15 +1677,19 @@ static int str_find_aux (lua_State *L, int find) {
   else {
     MatchState ms;
     const char *s1 = s + init;
+    const PatProg *pp = getprog(L, 2, p, lp);
     int anchor = (*p == '^');
     if (anchor) {
       p++; lp--;  /* skip anchor character */
     }
     prepstate(&ms, L, s, ls, p, lp);
+    ms.pp = pp;
     do {
       const char *res;
+      if (pp != NULL && !anchor && (s1 = skipto(pp, s1, ms.src_end)) == NULL)
+        break;  /* no match can start after 's1' */
       reprepstate(&ms);
-      if ((res=match(&ms, s1, p)) != NULL) {
+      if ((res=domatch(&ms, s1, p)) != NULL) {
         if (find) {
           lua_pushinteger(L, (s1 - s) + 1);  /* start */
           lua_pushinteger(L, res - s);   /* end */
@@ -841,8 +1730,11 @@ static int gmatch_aux (lua_State *L) {
   gm->ms.L = L;
   for (src = gm->src; src <= gm->ms.src_end; src++) {
     const char *e;
+    if (gm->ms.pp != NULL &&
+        (src = skipto(gm->ms.pp, src, gm->ms.src_end)) == NULL)
+      break;  /* no match can start after 'src' */
     reprepstate(&gm->ms);
-    if ((e = match(&gm->ms, src, gm->p)) != NULL && e != gm->lastmatch) {
+    if ((e = domatch(&gm->ms, src, gm->p)) != NULL && e != gm->lastmatch) {
       gm->src = gm->lastmatch = e;
       return push_captures(&gm->ms, src, e);
     }
@@ -853,7 +1745,7 @@ static int gmatch_aux (lua_State *L) {
 
 static int gmatch (lua_State *L) {
   size_t ls, lp;
-  const char *s = luaL_checklstring(L, 1, &ls);
+  const char *s = luaL_checklbytes(L, 1, &ls);
   const char *p = luaL_checklstring(L, 2, &lp);
   size_t init = posrelatI(luaL_optinteger(L, 3, 1), ls) - 1;
   GMatchState *gm;
@@ -862,8 +1754,12 @@ static int gmatch (lua_State *L) {
   if (init > ls)  /* start after string's end? */
     init = ls + 1;  /* avoid overflows in 's + init' */
   prepstate(&gm->ms, L, s, ls, p, lp);
+  if (*p != '^')  /* (compiled patterns handle '^' as an anchor) */
+    gm->ms.pp = getprog(L, 2, p, lp);  /* keep program on closure, too */
+  else
+    lua_pushnil(L);
   gm->src = s + init; gm->p = p; gm->lastmatch = NULL;
-  lua_pushcclosure(L, gmatch_aux, 3);
+  lua_pushcclosure(L, gmatch_aux, 4);
   return 1;
 }
 
@@ -941,7 +1837,7 @@ static int add_value (MatchState *ms, luaL_Buffer *b, const char *s,
 
 static int str_gsub (lua_State *L) {
   size_t srcl, lp;
-  const char *src = luaL_checklstring(L, 1, &srcl);  /* subject */
+  const char *src = luaL_checklbytes(L, 1, &srcl);  /* subject */
   const char *p = luaL_checklstring(L, 2, &lp);  /* pattern */
   const char *lastmatch = NULL;  /* end of last match */
   int tr = lua_type(L, 3);  /* replacement type */
@@ -949,20 +1845,30 @@ static int str_gsub (lua_State *L) {
   int anchor = (*p == '^');
   lua_Integer n = 0;  /* replacement count */
   int changed = 0;  /* change flag */
+  const PatProg *pp;
   MatchState ms;
   luaL_Buffer b;
   luaL_argexpected(L, tr == LUA_TNUMBER || tr == LUA_TSTRING ||
                    tr == LUA_TFUNCTION || tr == LUA_TTABLE, 3,
                       "string/function/table");
+  pp = getprog(L, 2, p, lp);
   luaL_buffinit(L, &b);
   if (anchor) {
     p++; lp--;  /* skip anchor character */
   }
   prepstate(&ms, L, src, srcl, p, lp);
+  ms.pp = pp;
   while (n < max_s) {
     const char *e;
+    if (pp != NULL && !anchor) {  /* skip places where no match starts */
+      const char *t = skipto(pp, src, ms.src_end);
+      if (t == NULL)
+        break;
+      luaL_addlstring(&b, src, t - src);
+      src = t;
+    }
     reprepstate(&ms);  /* (re)prepare state for new match */
-    if ((e = match(&ms, src, p)) != NULL && e != lastmatch) {  /* match? */
+    if ((e = domatch(&ms, src, p)) != NULL && e != lastmatch) {  /* match? */
       n++;
       changed = add_value(&ms, &b, src, e, tr) | changed;
       src = lastmatch = e;
@@ -1658,7 +2564,7 @@ static int str_pack (lua_State *L) {
       }
       case Kchar: {  /* fixed-size string */
         size_t len;
-        const char *s = luaL_checklstring(L, arg, &len);
+        const char *s = luaL_checklbytes(L, arg, &len);
         luaL_argcheck(L, len <= (size_t)size, arg,
                          "string longer than given size");
         luaL_addlstring(&b, s, len);  /* add string */
@@ -1668,7 +2574,7 @@ static int str_pack (lua_State *L) {
       }
       case Kstring: {  /* strings with length count */
         size_t len;
-        const char *s = luaL_checklstring(L, arg, &len);
+        const char *s = luaL_checklbytes(L, arg, &len);
         luaL_argcheck(L, size >= (int)sizeof(size_t) ||
                          len < ((size_t)1 << (size * NB)),
                          arg, "string length does not fit in given size");
@@ -1679,8 +2585,9 @@ static int str_pack (lua_State *L) {
       }
       case Kzstr: {  /* zero-terminated string */
         size_t len;
-        const char *s = luaL_checklstring(L, arg, &len);
-        luaL_argcheck(L, strlen(s) == len, arg, "string contains zeros");
+        const char *s = luaL_checklbytes(L, arg, &len);
+        luaL_argcheck(L, memchr(s, '\0', len) == NULL, arg,
+                         "string contains zeros");
         luaL_addlstring(&b, s, len);
         luaL_addchar(&b, '\0');  /* add zero at the end */
         totalsize += len + 1;
@@ -1755,7 +2662,7 @@ static int str_unpack (lua_State *L) {
   Header h;
   const char *fmt = luaL_checkstring(L, 1);
   size_t ld;
-  const char *data = luaL_checklstring(L, 2, &ld);
+  const char *data = luaL_checklbytes(L, 2, &ld);
   size_t pos = posrelatI(luaL_optinteger(L, 3, 1), ld) - 1;
   int n = 0;  /* number of results */
   luaL_argcheck(L, pos <= ld, 3, "initial position out of string");
@@ -1807,9 +2714,10 @@ static int str_unpack (lua_State *L) {
         break;
       }
       case Kzstr: {
-        size_t len = strlen(data + pos);
-        luaL_argcheck(L, pos + len < ld, 2,
-                         "unfinished string for format 'z'");
+        const char *z = (const char *)memchr(data + pos, '\0', ld - pos);
+        size_t len;
+        luaL_argcheck(L, z != NULL, 2, "unfinished string for format 'z'");
+        len = (size_t)(z - (data + pos));
         lua_pushlstring(L, data + pos, len);
         pos += len + 1;  /* skip string plus final '\0' */
         break;
@@ -1867,7 +2775,9 @@ static void createmetatable (lua_State *L) {
 ** Open string library
 */
 LUAMOD_API int luaopen_string (lua_State *L) {
-  luaL_newlib(L, strlib);
+  luaL_newlibtable(L, strlib);
+  newpatcache(L);
+  luaL_setfuncs(L, strlib, 1);  /* all functions share the cache */
   createmetatable(L);
   return 1;
 }
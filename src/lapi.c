@@ -149,6 +149,7 @@ LUA_API void lua_xmove (lua_State *from, lua_State *to, int n) {
   api_check(from, G(from) == G(to), "moving among independent states");
   api_check(from, to->ci->top - to->top >= n, "stack overflow");
   from->top -= n;
+  luaC_threadbarrier(to, to);
   for (i = 0; i < n; i++) {
     setobjs2s(to, to->top, from->top + i);
     to->top++;  /* stack already checked by previous 'api_check' 堆栈已由上一个 'api_check' 检查 */
@@ -283,6 +284,8 @@ LUA_API void lua_copy (lua_State *L, int fromidx, int toidx) {
   setobj(L, to, fr);
   if (isupvalue(toidx))  /* function upvalue? 是否为上值函数 */
     luaC_barrier(L, clCvalue(s2v(L->ci->func)), fr);
+  else if (!ispseudo(toidx))  /* stack slot? 是否为堆栈槽 */
+    luaC_threadbarrier(L, L);
   /* LUA_REGISTRYINDEX does not need gc barrier 不需要gc屏障
      (collector revisits it before finishing collection) 
     （收藏者在完成收集之前重新查看它）
@@ -371,6 +374,7 @@ LUA_API void lua_arith (lua_State *L, int op) {
       第一个操作数位于 top-2，第二个操作数在 top-1； 结果进入 top-2
   */
   luaO_arith(L, op, s2v(L->top - 2), s2v(L->top - 1), L->top - 2);
+  luaC_threadbarrier(L, L);
   L->top--;  /* remove second operand 删除第二个操作数 */
   lua_unlock(L);
 }
@@ -430,24 +434,53 @@ LUA_API int lua_toboolean (lua_State *L, int idx) {
 }
 
 
-LUA_API const char *lua_tolstring (lua_State *L, int idx, size_t *len) {
-  TValue *o;
-  lua_lock(L);
-  o = index2value(L, idx);
+/*
+** Get the string at index 'idx', converting a number in place. Returns
+** NULL if the value is neither a string nor a number.
+*/
+static TString *tostr (lua_State *L, int idx) {
+  TValue *o = index2value(L, idx);
   if (!ttisstring(o)) {
-    if (!cvt2str(o)) {  /* not convertible? 不可转换？ */
-      if (len != NULL) *len = 0;
-      lua_unlock(L);
+    if (!cvt2str(o))  /* not convertible? 不可转换？ */
       return NULL;
-    }
     luaO_tostring(L, o);
+    luaC_threadbarrier(L, L);
     luaC_checkGC(L);
     o = index2value(L, idx);  /* previous call may reallocate the stack 先前的调用可能会重新分配堆栈 */
   }
+  return tsvalue(o);
+}
+
+
+LUA_API const char *lua_tolstring (lua_State *L, int idx, size_t *len) {
+  TString *ts;
+  const char *s = NULL;
+  lua_lock(L);
+  ts = tostr(L, idx);
+  if (len != NULL)
+    *len = (ts != NULL) ? tsslen(ts) : 0;
+  if (ts != NULL)
+    s = luaS_cstr(L, ts);  /* a slice needs its final '\0' */
+  lua_unlock(L);
+  return s;
+}
+
+
+/*
+** Same as 'lua_tolstring', but the result may lack a final '\0', so
+** that slices are not materialized.
+*/
+LUA_API const char *lua_tolbytes (lua_State *L, int idx, size_t *len) {
+  TString *ts;
+  const char *s = NULL;
+  lua_lock(L);
+  ts = tostr(L, idx);
   if (len != NULL)
-    *len = vslen(o);
+    *len = (ts != NULL) ? tsslen(ts) : 0;
+  if (ts != NULL)
+    s = getstr(ts);
   lua_unlock(L);
-  return svalue(o);
+  return s;
 }
 
 
@@ -580,6 +613,46 @@ LUA_API const char *lua_pushstring (lua_State *L, const char *s) {
 }
 
 
+/*
+** Pushes on the stack a string whose contents stay in the buffer 's'
+** (which must have a '\0' at 's[len]'), freed with 'falloc' (if not
+** NULL) when Lua does not need it anymore.
+*/
+LUA_API const char *lua_pushexternalstring (lua_State *L,
+                const char *s, size_t len, lua_Alloc falloc, void *ud) {
+  TString *ts;
+  lua_lock(L);
+  api_check(L, len <= MAX_SIZE - sizeof(TString), "string too large");
+  api_check(L, s[len] == '\0', "string not ending with zero");
+  ts = luaS_newextlstr(L, s, len, falloc, ud);
+  setsvalue2s(L, L->top, ts);
+  api_incr_top(L);
+  luaC_checkGC(L);
+  lua_unlock(L);
+  return getstr(ts);
+}
+
+
+/*
+** Pushes on the stack the substring with 'len' bytes of the string at
+** index 'idx' starting at offset 'i'. Long substrings may share their
+** contents with the original string (see 'luaS_sub').
+*/
+LUA_API void lua_pushsubstring (lua_State *L, int idx, size_t i, size_t len) {
+  const TValue *o;
+  TString *ts;
+  lua_lock(L);
+  o = index2value(L, idx);
+  api_check(L, ttisstring(o), "string expected");
+  api_check(L, i <= vslen(o) && len <= vslen(o) - i, "invalid substring");
+  ts = luaS_sub(L, tsvalue(o), i, len);
+  setsvalue2s(L, L->top, ts);
+  api_incr_top(L);
+  luaC_checkGC(L);
+  lua_unlock(L);
+}
+
+
 LUA_API const char *lua_pushvfstring (lua_State *L, const char *fmt,
                                       va_list argp) {
   const char *ret;
@@ -709,6 +782,7 @@ LUA_API int lua_gettable (lua_State *L, int idx) {
   }
   else
     luaV_finishget(L, t, s2v(L->top - 1), L->top - 1, slot);
+  luaC_threadbarrier(L, L);
   lua_unlock(L);
   return ttype(s2v(L->top - 1));
 }
@@ -928,7 +1002,6 @@ static void aux_rawset (lua_State *L, int idx, TValue *key, int n) {
   t = gettable(L, idx);
   luaH_set(L, t, key, s2v(L->top - 1));
   invalidateTMcache(t);
-  luaC_barrierback(L, obj2gco(t), s2v(L->top - 1));
   L->top -= n;
   lua_unlock(L);
 }
@@ -952,7 +1025,6 @@ LUA_API void lua_rawseti (lua_State *L, int idx, lua_Integer n) {
   api_checknelems(L, 1);
   t = gettable(L, idx);
   luaH_setint(L, t, n, s2v(L->top - 1));
-  luaC_barrierback(L, obj2gco(t), s2v(L->top - 1));
   L->top--;
   lua_unlock(L);
 }
@@ -1149,6 +1221,15 @@ LUA_API int lua_dump (lua_State *L, lua_Writer writer, void *data, int strip) {
 }
 
 
+LUA_API int lua_heapsnapshot (lua_State *L, lua_Writer writer, void *data) {
+  int status;
+  lua_lock(L);
+  status = luaC_snapshot(L, writer, data);
+  lua_unlock(L);
+  return status;
+}
+
+
 LUA_API int lua_status (lua_State *L) {
   return L->status;
 }
@@ -1157,6 +1238,13 @@ LUA_API int lua_status (lua_State *L) {
 /*
 ** Garbage-collection function
 */
+
+/* collector mode, as given by the API */
+#define gcmode(g)  \
+	((g)->gcadaptive ? LUA_GCADAPTIVE  \
+	                 : isdecGCmodegen(g) ? LUA_GCGEN : LUA_GCINC)
+
+
 LUA_API int lua_gc (lua_State *L, int what, ...) {
   va_list argp;
   int res = 0;
@@ -1207,6 +1295,14 @@ LUA_API int lua_gc (lua_State *L, int what, ...) {
         res = 1;  /* signal it */
       break;
     }
+    case LUA_GCSTEPUS: {
+      int data = va_arg(argp, int);  /* time budget in microseconds */
+      lu_byte oldstp = g->gcstp;
+      g->gcstp = 0;  /* allow GC to run (GCSTPGC must be zero here) */
+      res = luaC_stepfor(L, (data > 0) ? cast(lu_mem, data) : 0);
+      g->gcstp = oldstp;  /* restore previous state */
+      break;
+    }
     case LUA_GCSETPAUSE: {
       int data = va_arg(argp, int);
       res = getgcparam(g->gcpause);
@@ -1226,11 +1322,12 @@ LUA_API int lua_gc (lua_State *L, int what, ...) {
     case LUA_GCGEN: {
       int minormul = va_arg(argp, int);
       int majormul = va_arg(argp, int);
-      res = isdecGCmodegen(g) ? LUA_GCGEN : LUA_GCINC;
+      res = gcmode(g);
       if (minormul != 0)
         g->genminormul = minormul;
       if (majormul != 0)
         setgcparam(g->genmajormul, majormul);
+      luaC_adaptive(L, 0);
       luaC_changemode(L, KGC_GEN);
       break;
     }
@@ -1238,16 +1335,59 @@ LUA_API int lua_gc (lua_State *L, int what, ...) {
       int pause = va_arg(argp, int);
       int stepmul = va_arg(argp, int);
       int stepsize = va_arg(argp, int);
-      res = isdecGCmodegen(g) ? LUA_GCGEN : LUA_GCINC;
+      res = gcmode(g);
       if (pause != 0)
         setgcparam(g->gcpause, pause);
       if (stepmul != 0)
         setgcparam(g->gcstepmul, stepmul);
       if (stepsize != 0)
         g->gcstepsize = stepsize;
+      luaC_adaptive(L, 0);
       luaC_changemode(L, KGC_INC);
       break;
     }
+    case LUA_GCADAPTIVE: {
+      res = gcmode(g);
+      luaC_adaptive(L, 1);
+      break;
+    }
+    case LUA_GCFINBUDGET: {
+      int data = va_arg(argp, int);  /* new budget in microseconds */
+      res = cast_int(g->gcfinbudget);
+      if (data >= 0)  /* negative values only query the budget */
+        g->gcfinbudget = cast(lu_mem, data);
+      break;
+    }
+    case LUA_GCFINALIZE: {
+      int data = va_arg(argp, int);  /* time limit in microseconds */
+      lu_mem pending;
+      if (data < 0) data = 0;
+      pending = luaC_runfinalizers(L, cast(lu_mem, data));
+      res = (pending < MAX_INT) ? cast_int(pending) : MAX_INT;
+      break;
+    }
+    case LUA_GCSOFTLIMIT:
+    case LUA_GCHARDLIMIT: {
+      int data = va_arg(argp, int);  /* new limit in Kbytes */
+      lu_mem *limit = (what == LUA_GCSOFTLIMIT) ? &g->memsoftlimit
+                                                : &g->memhardlimit;
+      res = cast_int(*limit >> 10);
+      if (data >= 0) {  /* negative values only query the limit */
+        *limit = cast(lu_mem, data) << 10;
+        g->memsoftsignaled = 0;
+        luaE_setmemcheck(g);
+      }
+      break;
+    }
+    case LUA_GCALLOCSAMPLE: {
+      int data = va_arg(argp, int);  /* new sampling rate in bytes */
+      res = cast_int(g->samplerate);
+      if (data >= 0) {  /* negative values only query the rate */
+        g->samplerate = cast(lu_mem, data);
+        g->allocsample = (data > 0) ? cast(l_mem, data) : MAX_LMEM;
+      }
+      break;
+    }
     default: res = -1;  /* invalid option */
   }
   va_end(argp);
@@ -1256,6 +1396,36 @@ LUA_API int lua_gc (lua_State *L, int what, ...) {
 }
 
 
+LUA_API void lua_pushregion (lua_State *L) {
+  lua_lock(L);
+  luaC_pushregion(L);
+  lua_unlock(L);
+}
+
+
+LUA_API int lua_popregion (lua_State *L) {
+  int res;
+  lua_lock(L);
+  api_check(L, G(L)->nregions > 0, "no open region");
+  res = luaC_popregion(L);
+  lua_unlock(L);
+  return res;
+}
+
+
+LUA_API int lua_allocprofile (lua_State *L, lua_Writer writer, void *data,
+                              int reset) {
+  int status = 0;
+  lua_lock(L);
+  if (writer != NULL)
+    status = luaG_allocprofile(L, writer, data);
+  if (reset)
+    luaG_freeallocprofile(G(L));
+  lua_unlock(L);
+  return status;
+}
+
+
 
 /*
 ** miscellaneous functions
@@ -1312,8 +1482,10 @@ LUA_API void lua_toclose (lua_State *L, int idx) {
 LUA_API void lua_concat (lua_State *L, int n) {
   lua_lock(L);
   api_checknelems(L, n);
-  if (n > 0)
+  if (n > 0) {
     luaV_concat(L, n);
+    luaC_threadbarrier(L, L);
+  }
   else {  /* nothing to concatenate */
     setsvalue2s(L, L->top, luaS_newlstr(L, "", 0));  /* push empty string */
     api_incr_top(L);
@@ -1351,6 +1523,58 @@ LUA_API void lua_setallocf (lua_State *L, lua_Alloc f, void *ud) {
 }
 
 
+LUA_API int lua_setstrcmp (lua_State *L, int mode) {
+  int old;
+  lua_lock(L);
+  api_check(L, mode == LUA_STRCMPLOCALE || mode == LUA_STRCMPBYTES,
+               "invalid comparison mode");
+  old = G(L)->strcmpmode;
+  G(L)->strcmpmode = cast_byte(mode);
+  lua_unlock(L);
+  return old;
+}
+
+
+LUA_API void lua_setmemlimitf (lua_State *L, lua_MemLimitFunction f,
+                               void *ud) {
+  lua_lock(L);
+  G(L)->ud_memlimit = ud;
+  G(L)->memlimitf = f;
+  lua_unlock(L);
+}
+
+
+LUA_API void lua_gcstats (lua_State *L, lua_GCStats *stats) {
+  global_State *g;
+  lua_lock(L);
+  g = G(L);
+  stats->mode = isdecGCmodegen(g) ? LUA_GCGEN : LUA_GCINC;
+  stats->adaptive = g->gcadaptive;
+  stats->cycles = cast_sizet(g->gccycles);
+  stats->minors = cast_sizet(g->gcminors);
+  stats->switches = cast_sizet(g->gcswitches);
+  stats->lastswitch = g->gclastswitch;
+  stats->finpending = cast_sizet(g->gcfinpending);
+  stats->finalized = cast_sizet(g->gcfinalized);
+  stats->largebytes = cast_sizet(g->lobytes);
+  stats->pretenured = cast_sizet(g->gcpretenured);
+  lua_unlock(L);
+}
+
+
+LUA_API void lua_gctypes (lua_State *L, lua_GCTypes *types) {
+  global_State *g;
+  int i;
+  lua_lock(L);
+  g = G(L);
+  for (i = 0; i < LUA_NUMGCKINDS; i++) {
+    types->count[i] = cast_sizet(g->gcobjs[i]);
+    types->bytes[i] = cast_sizet(g->gcobjbytes[i]);
+  }
+  lua_unlock(L);
+}
+
+
 void lua_setwarnf (lua_State *L, lua_WarnFunction f, void *ud) {
   lua_lock(L);
   G(L)->ud_warn = ud;
@@ -9,6 +9,7 @@
 #define lapi_h
 
 
+#include "lgc.h"
 #include "llimits.h"
 #include "lstate.h"
 
@@ -16,9 +17,11 @@
 /* 
     Increments 'L->top', checking for stack overflows 
 	递增 'L->top' ，检查堆栈溢出
+    (The thread may be a black quiet one; see 'luaC_threadbarrier'.)
+    （线程可能是黑色的静止线程；参见 'luaC_threadbarrier'。）
 */
 #define api_incr_top(L)   {L->top++; api_check(L, L->top <= L->ci->top, \
-				"stack overflow");}
+				"stack overflow"); luaC_threadbarrier(L, L);}
 
 
 /*
@@ -8,6 +8,10 @@
 #define lauxlib_c
 #define LUA_LIB
 
+#if defined(LUA_USE_LINUX) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE	/* for 'mremap' */
+#endif
+
 #include "lprefix.h"
 
 
@@ -421,6 +425,29 @@ LUALIB_API const char *luaL_optlstring (lua_State *L, int arg,
 }
 
 
+/*
+** Variants of 'luaL_checklstring' and 'luaL_optlstring' for functions
+** that use only the first 'len' bytes of the string: the result may
+** lack a final '\0' (see 'lua_tolbytes').
+*/
+LUALIB_API const char *luaL_checklbytes (lua_State *L, int arg, size_t *len) {
+  const char *s = lua_tolbytes(L, arg, len);
+  if (l_unlikely(!s)) tag_error(L, arg, LUA_TSTRING);
+  return s;
+}
+
+
+LUALIB_API const char *luaL_optlbytes (lua_State *L, int arg,
+                                       const char *def, size_t *len) {
+  if (lua_isnoneornil(L, arg)) {
+    if (len)
+      *len = (def ? strlen(def) : 0);
+    return def;
+  }
+  else return luaL_checklbytes(L, arg, len);
+}
+
+
 LUALIB_API lua_Number luaL_checknumber (lua_State *L, int arg) {
   int isnum;
   lua_Number d = lua_tonumberx(L, arg, &isnum);
@@ -534,7 +561,7 @@ static void newbox (lua_State *L) {
 */
 static size_t newbuffsize (luaL_Buffer *B, size_t sz) {
   size_t newsize = B->size * 2;  /* double buffer size */
-  if (l_unlikely(MAX_SIZET - sz < B->n))  /* overflow in (B->n + sz)? */
+  if (l_unlikely(MAX_SIZET - sz <= B->n))  /* overflow in (B->n + sz)? */
     return luaL_error(B->L, "buffer too large");
   if (newsize < B->n + sz)  /* double is not big enough? */
     newsize = B->n + sz;
@@ -555,15 +582,15 @@ static char *prepbuffsize (luaL_Buffer *B, size_t sz, int boxidx) {
     lua_State *L = B->L;
     char *newbuff;
     size_t newsize = newbuffsize(B, sz);
-    /* create larger buffer */
+    /* create larger buffer (with room for a final '\0'; see 'adoptbox') */
     if (buffonstack(B))  /* buffer already has a box? */
-      newbuff = (char *)resizebox(L, boxidx, newsize);  /* resize it */
+      newbuff = (char *)resizebox(L, boxidx, newsize + 1);  /* resize it */
     else {  /* no box yet */
       lua_remove(L, boxidx);  /* remove placeholder */
       newbox(L);  /* create a new box */
       lua_insert(L, boxidx);  /* move box to its intended position */
       lua_toclose(L, boxidx);
-      newbuff = (char *)resizebox(L, boxidx, newsize);
+      newbuff = (char *)resizebox(L, boxidx, newsize + 1);
       memcpy(newbuff, B->b, B->n * sizeof(char));  /* copy original content */
     }
     B->b = newbuff;
@@ -594,12 +621,37 @@ LUALIB_API void luaL_addstring (luaL_Buffer *B, const char *s) {
 }
 
 
+/*
+** A buffer in a box was allocated with the state's allocator, so the
+** box can hand it to Lua as the contents of the result, without
+** copying it. The block, which always has room for a final '\0', is
+** first trimmed to the result size plus that '\0', which is the size
+** Lua will use to free it. The box lets
+** go of the block before the push, as the push frees it on errors.
+** 盒子中的缓冲区直接成为结果字符串的内容，无需复制。
+*/
+static void adoptbox (luaL_Buffer *B) {
+  lua_State *L = B->L;
+  void *ud;
+  lua_Alloc allocf = lua_getallocf(L, &ud);
+  UBox *box = (UBox *)lua_touserdata(L, -1);
+  char *b = (char *)resizebox(L, -1, B->n + 1);  /* trim it */
+  b[B->n] = '\0';
+  box->box = NULL;  /* the block now belongs to the string */
+  box->bsize = 0;
+  lua_pushexternalstring(L, b, B->n, allocf, ud);
+}
+
+
 LUALIB_API void luaL_pushresult (luaL_Buffer *B) {
   lua_State *L = B->L;
   checkbufferlevel(B, -1);
-  lua_pushlstring(L, B->b, B->n);
-  if (buffonstack(B))
+  if (buffonstack(B)) {
+    adoptbox(B);
     lua_closeslot(L, -2);  /* close the box */
+  }
+  else
+    lua_pushlstring(L, B->b, B->n);
   lua_remove(L, -2);  /* remove box or placeholder from the stack */
 }
 
@@ -622,7 +674,7 @@ LUALIB_API void luaL_pushresultsize (luaL_Buffer *B, size_t sz) {
 LUALIB_API void luaL_addvalue (luaL_Buffer *B) {
   lua_State *L = B->L;
   size_t len;
-  const char *s = lua_tolstring(L, -1, &len);
+  const char *s = lua_tolbytes(L, -1, &len);
   char *b = prepbuffsize(B, len, -2);
   memcpy(b, s, len * sizeof(char));
   luaL_addsize(B, len);
@@ -1012,8 +1064,183 @@ LUALIB_API const char *luaL_gsub (lua_State *L, const char *s,
 }
 
 
+/*
+** {======================================================
+** Large blocks
+** =======================================================
+*/
+
+#if defined(LUA_USE_MMAP)	/* { */
+
+/*
+** Blocks with at least LUAI_LARGEOBJ bytes are mapped directly from the
+** system. So, they do not fragment the arenas of 'malloc', and their
+** pages go back to the system as soon as they are freed or shrunk.
+** Lua always gives the real old size of a block, so the size alone
+** tells which blocks are mapped.
+*/
+
+#include <sys/mman.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define islarge(s)	((s) >= LUAI_LARGEOBJ)
+
+
+/*
+** Length of the mapping that holds a large block of size 's'. The
+** kernel rounds lengths up by itself, but addresses computed from a
+** length must land on a page boundary.
+*/
+static size_t mapsize (size_t s) {
+  static size_t pagesize = 0;
+  if (pagesize == 0)
+    pagesize = (size_t)sysconf(_SC_PAGESIZE);
+  return (s + pagesize - 1) & ~(pagesize - 1);
+}
+
+
+#if defined(MADV_HUGEPAGE)
+
+/*
+** Blocks spanning at least one huge page (big hash parts, arrays, and
+** strings) start at a huge-page boundary and are marked as candidates
+** for transparent huge pages, so that walking them does not thrash
+** the TLB. The hint is only advisory; it is harmless where huge pages
+** are disabled. (It always covers whole blocks: advising only part of
+** a mapping would split it, and 'mremap' cannot move split mappings.)
+*/
+
+#define HUGEPAGE	((size_t)2 << 20)
+
+#define ishuge(s)	((s) >= HUGEPAGE)
+
+#define advisehuge(p,s)	madvise(p, s, MADV_HUGEPAGE)
+
+
+/*
+** Map 'size' bytes starting at a huge-page boundary: map a bit more
+** than needed and give back the unaligned head and the extra tail.
+** If the trimming fails, give back everything and let the caller use
+** a plain mapping.
+*/
+static void *newhuge (size_t size) {
+  size_t msize = mapsize(size);
+  size_t head, tail;
+  char *p = (char *)mmap(NULL, msize + HUGEPAGE, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == (char *)MAP_FAILED)
+    return NULL;
+  head = (size_t)(-(uintptr_t)p & (HUGEPAGE - 1));
+  tail = HUGEPAGE - head;
+  if (munmap(p + head + msize, tail) != 0 ||
+      (head > 0 && munmap(p, head) != 0)) {
+    munmap(p, msize + HUGEPAGE);
+    return NULL;
+  }
+  p += head;
+  advisehuge(p, size);
+  return p;
+}
+
+
+/*
+** Keep huge block 'p', just resized by 'mremap' from 'osize' to
+** 'nsize' bytes, aligned and advised: a moving 'mremap' does not keep
+** the alignment, so move its pages (without copying them) to a new
+** aligned place. If that fails, the block stays where it is.
+*/
+static void *keephuge (void *p, size_t osize, size_t nsize) {
+  if (((uintptr_t)p & (HUGEPAGE - 1)) != 0) {  /* not aligned? */
+    size_t msize = mapsize(nsize);
+    void *q = newhuge(nsize);
+    if (q != NULL) {
+      void *r = mremap(p, msize, msize, MREMAP_MAYMOVE | MREMAP_FIXED, q);
+      if (r != MAP_FAILED) {
+        advisehuge(r, nsize);  /* the moved pages bring their old flags */
+        return r;
+      }
+      munmap(q, msize);
+    }
+  }
+  else if (!ishuge(osize))  /* grown into huge pages? */
+    advisehuge(p, nsize);
+  return p;
+}
+
+#else
+
+#define ishuge(s)	0
+#define newhuge(s)	NULL
+#define keephuge(p,o,n)	(p)
+
+#endif
+
+
+static void *newlarge (size_t size) {
+  void *p;
+  if (ishuge(size) && (p = newhuge(size)) != NULL)
+    return p;
+  p = mmap(NULL, mapsize(size), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return (p == MAP_FAILED) ? NULL : p;
+}
+
+
+static void *l_largealloc (void *ptr, size_t osize, size_t nsize) {
+  void *newblock;
+  if (nsize == 0) {  /* free a large block */
+    munmap(ptr, mapsize(osize));
+    return NULL;
+  }
+  else if (islarge(osize) && islarge(nsize)) {  /* large to large */
+    newblock = mremap(ptr, mapsize(osize), mapsize(nsize),
+                                MREMAP_MAYMOVE);
+    if (newblock != MAP_FAILED) {
+      if (ishuge(nsize))
+        newblock = keephuge(newblock, osize, nsize);
+      return newblock;
+    }
+    newblock = newlarge(nsize);  /* try a new mapping */
+    if (newblock != NULL) {
+      memcpy(newblock, ptr, (osize < nsize) ? osize : nsize);
+      munmap(ptr, mapsize(osize));
+    }
+    return newblock;
+  }
+  else if (islarge(nsize)) {  /* small (or new) to large */
+    newblock = newlarge(nsize);
+    if (newblock != NULL && ptr != NULL) {
+      memcpy(newblock, ptr, osize);
+      free(ptr);
+    }
+    return newblock;
+  }
+  else {  /* large to small */
+    newblock = malloc(nsize);
+    if (newblock != NULL) {
+      memcpy(newblock, ptr, nsize);
+      munmap(ptr, mapsize(osize));
+    }
+    return newblock;
+  }
+}
+
+#endif				/* } */
+
+/* }====================================================== */
+
+
 static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
-  (void)ud; (void)osize;  /* not used */
+  (void)ud;
+#if defined(LUA_USE_MMAP)
+  if (ptr == NULL)
+    osize = 0;  /* 'osize' codes the type of a new object */
+  if (l_unlikely(islarge(osize) || islarge(nsize)))
+    return l_largealloc(ptr, osize, nsize);
+#else
+  (void)osize;  /* not used */
+#endif
   if (nsize == 0) {
     free(ptr);
     return NULL;
@@ -65,6 +65,10 @@ LUALIB_API const char *(luaL_checklstring) (lua_State *L, int arg,
                                                           size_t *l);
 LUALIB_API const char *(luaL_optlstring) (lua_State *L, int arg,
                                           const char *def, size_t *l);
+LUALIB_API const char *(luaL_checklbytes) (lua_State *L, int arg,
+                                                         size_t *l);
+LUALIB_API const char *(luaL_optlbytes) (lua_State *L, int arg,
+                                         const char *def, size_t *l);
 LUALIB_API lua_Number (luaL_checknumber) (lua_State *L, int arg);
 LUALIB_API lua_Number (luaL_optnumber) (lua_State *L, int arg, lua_Number def);
 
@@ -13,6 +13,7 @@
 
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "lua.h"
@@ -917,3 +918,475 @@ int luaG_traceexec (lua_State *L, const Instruction *pc) {
   return 1;  /* keep 'trap' on */
 }
 
+
+
+/*
+** {======================================================
+** Allocation sampling
+** =======================================================
+*/
+
+/* maximum number of stack levels recorded in a sample */
+#if !defined(LUAI_MAXSAMPLEDEPTH)
+#define LUAI_MAXSAMPLEDEPTH	64
+#endif
+
+/* size of the buffer used to write a profile */
+#if !defined(LUAI_PROFILEBUFF)
+#define LUAI_PROFILEBUFF	1024
+#endif
+
+
+/*
+** The sampler keeps its data outside the collector's accounting: it
+** allocates directly with 'frealloc', and everything is interned in
+** tables of byte keys. Strings, functions (name, file, first line),
+** locations (function, line) and stacks (list of locations) are kept
+** in separate tables; entry 'i' of a table has id 'i + 1', except for
+** strings, whose ids are their indices (as in a pprof string table).
+*/
+typedef struct ProfEntry {
+  size_t key;  /* offset of the key in 'keys' */
+  size_t len;  /* size of the key */
+  unsigned int hash;
+  int next;  /* next entry in the same chain (-1 if none) */
+  lu_mem count;  /* estimated number of allocations (for stacks) */
+  lu_mem bytes;  /* estimated number of bytes (for stacks) */
+} ProfEntry;
+
+
+typedef struct ProfTable {
+  ProfEntry *entries;
+  int *chains;  /* first entry in each chain (-1 if none) */
+  int n;  /* number of entries in use */
+  int size;  /* size of 'entries' and of 'chains' (a power of 2) */
+  char *keys;  /* keys of all entries, one after another */
+  size_t nkeys;  /* number of bytes in use in 'keys' */
+  size_t sizekeys;  /* size of 'keys' */
+} ProfTable;
+
+
+typedef struct AllocProfile {
+  ProfTable strings;
+  ProfTable functions;
+  ProfTable locations;
+  ProfTable stacks;
+  unsigned int rand;  /* state of generator for sampling intervals */
+} AllocProfile;
+
+
+/* fixed entries in the string table */
+static const char *const profnames[] = {
+  "", "alloc_objects", "count", "alloc_space", "bytes", "space", NULL
+};
+
+#define PROF_COUNT	2
+#define PROF_BYTES	4
+#define PROF_SPACE	5
+
+
+static void freetable (global_State *g, ProfTable *t) {
+  (*g->frealloc)(g->ud, t->entries, t->size * sizeof(ProfEntry), 0);
+  (*g->frealloc)(g->ud, t->chains, t->size * sizeof(int), 0);
+  (*g->frealloc)(g->ud, t->keys, t->sizekeys, 0);
+}
+
+
+static int growtable (global_State *g, ProfTable *t) {
+  int size = (t->size > 0) ? t->size * 2 : 16;
+  int *chains;
+  ProfEntry *entries;
+  int i;
+  if (size > MAX_INT / cast_int(sizeof(ProfEntry)))
+    return 0;  /* table too big */
+  chains = cast(int *, (*g->frealloc)(g->ud, NULL, 0, size * sizeof(int)));
+  if (chains == NULL)
+    return 0;
+  entries = cast(ProfEntry *, (*g->frealloc)(g->ud, t->entries,
+                  t->size * sizeof(ProfEntry), size * sizeof(ProfEntry)));
+  if (entries == NULL) {
+    (*g->frealloc)(g->ud, chains, size * sizeof(int), 0);
+    return 0;
+  }
+  (*g->frealloc)(g->ud, t->chains, t->size * sizeof(int), 0);
+  for (i = 0; i < size; i++)
+    chains[i] = -1;
+  for (i = 0; i < t->n; i++) {  /* rehash old entries */
+    int h = lmod(entries[i].hash, size);
+    entries[i].next = chains[h];
+    chains[h] = i;
+  }
+  t->entries = entries;
+  t->chains = chains;
+  t->size = size;
+  return 1;
+}
+
+
+static int growkeys (global_State *g, ProfTable *t, size_t len) {
+  size_t size = (t->sizekeys > 0) ? t->sizekeys * 2 : 256;
+  char *keys;
+  while (size - t->nkeys < len)
+    size *= 2;
+  keys = cast_charp((*g->frealloc)(g->ud, t->keys, t->sizekeys, size));
+  if (keys == NULL)
+    return 0;
+  t->keys = keys;
+  t->sizekeys = size;
+  return 1;
+}
+
+
+/*
+** Return the index of the entry with the given key in table 't',
+** creating it if needed. Returns -1 if it cannot allocate memory.
+*/
+static int intern (global_State *g, ProfTable *t, const void *key,
+                   size_t len) {
+  unsigned int h = luaS_hash(cast_charp(key), len, g->seed);
+  ProfEntry *e;
+  int i;
+  if (t->size > 0) {
+    for (i = t->chains[lmod(h, t->size)]; i >= 0; i = t->entries[i].next) {
+      e = &t->entries[i];
+      if (e->hash == h && e->len == len &&
+          memcmp(t->keys + e->key, key, len) == 0)
+        return i;  /* found it */
+    }
+  }
+  if ((t->n == t->size && !growtable(g, t)) ||
+      ((t->keys == NULL || t->sizekeys - t->nkeys < len) &&
+       !growkeys(g, t, len)))
+    return -1;
+  i = t->n++;
+  e = &t->entries[i];
+  e->key = t->nkeys;
+  e->len = len;
+  e->hash = h;
+  e->count = e->bytes = 0;
+  memcpy(t->keys + t->nkeys, key, len);
+  t->nkeys += len;
+  e->next = t->chains[lmod(h, t->size)];
+  t->chains[lmod(h, t->size)] = i;
+  return i;
+}
+
+
+#define internstr(g,ap,s)	intern(g, &(ap)->strings, s, strlen(s))
+
+
+static AllocProfile *newprofile (global_State *g) {
+  AllocProfile *ap = cast(AllocProfile *,
+                          (*g->frealloc)(g->ud, NULL, 0, sizeof(AllocProfile)));
+  int i;
+  if (ap == NULL)
+    return NULL;
+  memset(ap, 0, sizeof(AllocProfile));
+  ap->rand = g->seed | 1;  /* generator state cannot be zero */
+  for (i = 0; profnames[i] != NULL; i++) {
+    if (internstr(g, ap, profnames[i]) != i) {  /* not enough memory? */
+      g->allocprof = ap;
+      luaG_freeallocprofile(g);
+      return NULL;
+    }
+  }
+  return ap;
+}
+
+
+void luaG_freeallocprofile (global_State *g) {
+  AllocProfile *ap = g->allocprof;
+  if (ap != NULL) {
+    freetable(g, &ap->strings);
+    freetable(g, &ap->functions);
+    freetable(g, &ap->locations);
+    freetable(g, &ap->stacks);
+    (*g->frealloc)(g->ud, ap, sizeof(AllocProfile), 0);
+    g->allocprof = NULL;
+  }
+}
+
+
+/*
+** Random interval until next sample, uniformly distributed around
+** the sampling rate, so that periodic allocation patterns do not
+** bias the samples.
+*/
+static l_mem nextinterval (AllocProfile *ap, lu_mem rate) {
+  unsigned int r = ap->rand;
+  r ^= r << 13; r ^= r >> 17; r ^= r << 5;  /* xorshift */
+  ap->rand = r;
+  return cast(l_mem, rate - rate / 2 + r % rate);
+}
+
+
+/*
+** Location (as an id) of the code running in 'ci'. The function is
+** named after how it was called, when that is known.
+*/
+static int framelocation (lua_State *L, AllocProfile *ap, CallInfo *ci) {
+  global_State *g = G(L);
+  char src[LUA_IDSIZE];
+  char buff[LUA_IDSIZE + 32];
+  const char *name = NULL;
+  int fkey[3];  /* name, file, first line */
+  int lkey[2];  /* function, line */
+  getfuncname(L, ci, &name);
+  if (isLua(ci)) {
+    Proto *p = ci_func(ci)->p;
+    if (p->source)
+      luaO_chunkid(src, getstr(p->source), tsslen(p->source));
+    else
+      luaO_chunkid(src, "=?", LL("=?"));
+    if (name == NULL) {
+      if (p->linedefined == 0)
+        name = "main chunk";
+      else {  /* function <src:line> */
+        size_t l;
+        strcpy(buff, "function <");
+        strcat(buff, src);
+        l = strlen(buff);
+        buff[l++] = ':';
+        l += lua_integer2str(buff + l, sizeof(buff) - l, p->linedefined);
+        strcpy(buff + l, ">");
+        name = buff;
+      }
+    }
+    fkey[2] = p->linedefined;
+    lkey[1] = getcurrentline(ci);
+  }
+  else {
+    strcpy(src, "[C]");
+    if (name == NULL) {
+      lua_pointer2str(buff, sizeof(buff), cast_voidp(cast_sizet(
+          ttislcf(s2v(ci->func)) ? fvalue(s2v(ci->func))
+                                 : clCvalue(s2v(ci->func))->f)));
+      name = buff;
+    }
+    fkey[2] = 0;
+    lkey[1] = 0;
+  }
+  if ((fkey[0] = internstr(g, ap, name)) < 0 ||
+      (fkey[1] = internstr(g, ap, src)) < 0 ||
+      (lkey[0] = intern(g, &ap->functions, fkey, sizeof(fkey))) < 0)
+    return 0;
+  lkey[0]++;  /* function id */
+  if (lkey[1] < 0) lkey[1] = 0;  /* no line information */
+  return intern(g, &ap->locations, lkey, sizeof(lkey)) + 1;
+}
+
+
+/*
+** Called by the memory manager when the countdown of allocated bytes
+** for the next sample reaches zero, before allocating a block of 'size'
+** bytes. Records the stack of the allocating thread, crediting it with
+** the bytes (and objects of this size) that each sample stands for.
+*/
+void luaG_allocsample (lua_State *L, size_t size) {
+  global_State *g = G(L);
+  AllocProfile *ap = g->allocprof;
+  lu_mem rate = g->samplerate;
+  lu_mem n = 0;  /* number of samples this allocation stands for */
+  int locs[LUAI_MAXSAMPLEDEPTH];
+  int nlocs = 0;
+  CallInfo *ci;
+  int i;
+  if (rate == 0) {  /* sampling is off? */
+    g->allocsample = MAX_LMEM;
+    return;
+  }
+  if (ap == NULL && (ap = g->allocprof = newprofile(g)) == NULL) {
+    g->allocsample = cast(l_mem, rate);  /* no memory; skip this sample */
+    return;
+  }
+  do {
+    n++;
+    g->allocsample += nextinterval(ap, rate);
+  } while (g->allocsample <= 0);
+  for (ci = L->ci; ci != &L->base_ci && nlocs < LUAI_MAXSAMPLEDEPTH;
+                   ci = ci->previous) {
+    if ((locs[nlocs++] = framelocation(L, ap, ci)) == 0)
+      return;  /* no memory; skip this sample */
+  }
+  i = intern(g, &ap->stacks, locs, nlocs * sizeof(int));
+  if (i >= 0) {
+    ap->stacks.entries[i].count += (n * rate + size / 2) / size;
+    ap->stacks.entries[i].bytes += n * rate;
+  }
+}
+
+
+/*
+** The profile is written as a (non-compressed) protocol buffer in the
+** format read by pprof ('profile.proto'). Each message is built in a
+** small buffer, so that its length is known before it is written.
+*/
+typedef struct ProfState {
+  lua_State *L;
+  lua_Writer writer;
+  void *data;
+  int status;
+  size_t n;  /* number of bytes in 'buff' */
+  char buff[LUAI_PROFILEBUFF];
+} ProfState;
+
+
+/* maximum size of an encoded varint */
+#define MAXVARINT	10
+
+/* size of a buffer for a sample message */
+#define SAMPLEBUFF	((LUAI_MAXSAMPLEDEPTH + 2) * MAXVARINT + 4 * MAXVARINT)
+
+
+static void profflush (ProfState *P) {
+  if (P->status == 0 && P->n > 0)
+    P->status = (*P->writer)(P->L, P->buff, P->n, P->data);
+  P->n = 0;
+}
+
+
+static void profchars (ProfState *P, const char *s, size_t len) {
+  while (len > 0) {
+    size_t l = sizeof(P->buff) - P->n;
+    if (l == 0) {
+      profflush(P);
+      l = sizeof(P->buff);
+    }
+    if (l > len) l = len;
+    memcpy(P->buff + P->n, s, l);
+    P->n += l;
+    s += l;
+    len -= l;
+  }
+}
+
+
+static size_t pbvarint (char *buff, lu_mem x) {
+  size_t n = 0;
+  while (x >= 0x80) {
+    buff[n++] = cast_char((x & 0x7f) | 0x80);
+    x >>= 7;
+  }
+  buff[n++] = cast_char(x);
+  return n;
+}
+
+
+/* encode a varint field */
+static size_t pbint (char *buff, int field, lu_mem x) {
+  size_t n = pbvarint(buff, cast(lu_mem, field) << 3);
+  return n + pbvarint(buff + n, x);
+}
+
+
+/* encode the header of a length-delimited field */
+static size_t pbheader (char *buff, int field, size_t len) {
+  size_t n = pbvarint(buff, (cast(lu_mem, field) << 3) | 2);
+  return n + pbvarint(buff + n, len);
+}
+
+
+static void pbmessage (ProfState *P, int field, const char *msg,
+                                                size_t len) {
+  char h[2 * MAXVARINT];
+  profchars(P, h, pbheader(h, field, len));
+  profchars(P, msg, len);
+}
+
+
+static void pbvaluetype (ProfState *P, int field, int type, int unit) {
+  char msg[4 * MAXVARINT];
+  size_t n = pbint(msg, 1, type);
+  n += pbint(msg + n, 2, unit);
+  pbmessage(P, field, msg, n);
+}
+
+
+static void pbsample (ProfState *P, ProfTable *stacks, ProfEntry *e) {
+  char ids[LUAI_MAXSAMPLEDEPTH * MAXVARINT];
+  char msg[SAMPLEBUFF];
+  size_t nids = 0;
+  size_t n;
+  size_t i;
+  for (i = 0; i < e->len; i += sizeof(int)) {
+    int id;
+    memcpy(&id, stacks->keys + e->key + i, sizeof(int));
+    nids += pbvarint(ids + nids, id);
+  }
+  n = pbheader(msg, 1, nids);  /* location ids (packed) */
+  memcpy(msg + n, ids, nids);
+  n += nids;
+  nids = pbvarint(ids, e->count);
+  nids += pbvarint(ids + nids, e->bytes);
+  n += pbheader(msg + n, 2, nids);  /* values (packed) */
+  memcpy(msg + n, ids, nids);
+  n += nids;
+  pbmessage(P, 2, msg, n);
+}
+
+
+static void pblocation (ProfState *P, ProfTable *locations, int i) {
+  char line[4 * MAXVARINT];
+  char msg[8 * MAXVARINT];
+  int key[2];
+  size_t nline, n;
+  memcpy(key, locations->keys + locations->entries[i].key, sizeof(key));
+  nline = pbint(line, 1, key[0]);  /* function id */
+  nline += pbint(line + nline, 2, key[1]);  /* line */
+  n = pbint(msg, 1, i + 1);  /* location id */
+  n += pbheader(msg + n, 4, nline);
+  memcpy(msg + n, line, nline);
+  pbmessage(P, 4, msg, n + nline);
+}
+
+
+static void pbfunction (ProfState *P, ProfTable *functions, int i) {
+  char msg[5 * 2 * MAXVARINT];
+  int key[3];
+  size_t n;
+  memcpy(key, functions->keys + functions->entries[i].key, sizeof(key));
+  n = pbint(msg, 1, i + 1);  /* function id */
+  n += pbint(msg + n, 2, key[0]);  /* name */
+  n += pbint(msg + n, 3, key[0]);  /* system name */
+  n += pbint(msg + n, 4, key[1]);  /* file name */
+  n += pbint(msg + n, 5, key[2]);  /* first line */
+  pbmessage(P, 5, msg, n);
+}
+
+
+int luaG_allocprofile (lua_State *L, lua_Writer writer, void *data) {
+  global_State *g = G(L);
+  AllocProfile *ap = g->allocprof;
+  ProfState P;
+  char buff[2 * MAXVARINT];
+  int i;
+  P.L = L;
+  P.writer = writer;
+  P.data = data;
+  P.status = 0;
+  P.n = 0;
+  pbvaluetype(&P, 1, 1, PROF_COUNT);  /* alloc_objects/count */
+  pbvaluetype(&P, 1, 3, PROF_BYTES);  /* alloc_space/bytes */
+  if (ap != NULL) {
+    for (i = 0; i < ap->stacks.n; i++)
+      pbsample(&P, &ap->stacks, &ap->stacks.entries[i]);
+    for (i = 0; i < ap->locations.n; i++)
+      pblocation(&P, &ap->locations, i);
+    for (i = 0; i < ap->functions.n; i++)
+      pbfunction(&P, &ap->functions, i);
+    for (i = 0; i < ap->strings.n; i++) {
+      ProfEntry *e = &ap->strings.entries[i];
+      pbmessage(&P, 6, ap->strings.keys + e->key, e->len);
+    }
+  }
+  else {  /* no samples; write only the fixed strings */
+    for (i = 0; profnames[i] != NULL; i++)
+      pbmessage(&P, 6, profnames[i], strlen(profnames[i]));
+  }
+  pbvaluetype(&P, 11, PROF_SPACE, PROF_BYTES);  /* period type */
+  profchars(&P, buff, pbint(buff, 12, g->samplerate));  /* period */
+  profflush(&P);
+  return P.status;
+}
+
+/* }====================================================== */
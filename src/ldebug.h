@@ -61,6 +61,9 @@ LUAI_FUNC const char *luaG_addinfo (lua_State *L, const char *msg,
                                                   TString *src, int line);
 LUAI_FUNC l_noret luaG_errormsg (lua_State *L);
 LUAI_FUNC int luaG_traceexec (lua_State *L, const Instruction *pc);
+LUAI_FUNC void luaG_allocsample (lua_State *L, size_t size);
+LUAI_FUNC int luaG_allocprofile (lua_State *L, lua_Writer writer, void *data);
+LUAI_FUNC void luaG_freeallocprofile (global_State *g);
 
 
 #endif
@@ -122,6 +122,7 @@ l_noret luaD_throw (lua_State *L, int errcode) {
     global_State *g = G(L);
     errcode = luaE_resetthread(L, errcode);  /* close all upvalues */
     if (g->mainthread->errorJmp) {  /* main thread has a handler? */
+      luaC_threadbarrier(L, g->mainthread);
       setobjs2s(L, g->mainthread->top++, L->top - 1);  /* copy error obj. */
       luaD_throw(g->mainthread, errcode);  /* re-throw in main thread */
     }
@@ -207,6 +208,8 @@ int luaD_reallocstack (lua_State *L, int newsize, int raiseerror) {
     setnilvalue(s2v(newstack + i)); /* erase new segment */
   correctstack(L, L->stack, newstack);
   luaM_freearray(L, L->stack, oldsize + EXTRA_STACK);
+  luaC_kindbytes(G(L), LUA_GCKTHREAD,
+                 cast(l_mem, newsize - oldsize) * sizeof(StackValue));
   L->stack = newstack;
   L->stack_last = L->stack + newsize;
   return 1;
@@ -293,6 +296,7 @@ void luaD_shrinkstack (lua_State *L) {
 
 void luaD_inctop (lua_State *L) {
   luaD_checkstack(L, 1);
+  luaC_threadbarrier(L, L);
   L->top++;
 }
 
@@ -602,6 +606,7 @@ CallInfo *luaD_precall (lua_State *L, StkId func, int nresults) {
 */
 l_sinline void ccall (lua_State *L, StkId func, int nResults, int inc) {
   CallInfo *ci;
+  luaC_threadbarrier(L, L);  /* thread will run (and change its stack) */
   L->nCcalls += inc;
   if (l_unlikely(getCcalls(L) >= LUAI_MAXCCALLS))
     luaE_checkcstack(L);
@@ -814,6 +819,7 @@ LUA_API int lua_resume (lua_State *L, lua_State *from, int nargs,
   }
   else if (L->status != LUA_YIELD)  /* ended with errors? */
     return resume_error(L, "cannot resume dead coroutine", nargs);
+  luaC_threadbarrier(L, L);  /* thread will run (and change its stack) */
   L->nCcalls = (from) ? getCcalls(from) : 0;
   if (getCcalls(L) >= LUAI_MAXCCALLS)
     return resume_error(L, "C stack overflow", nargs);
@@ -268,6 +268,7 @@ Proto *luaF_newproto (lua_State *L) {
   f->numparams = 0;
   f->is_vararg = 0;
   f->maxstacksize = 0;
+  f->counted = 0;
   f->locvars = NULL;
   f->sizelocvars = 0;
   f->linedefined = 0;
@@ -276,8 +277,33 @@ Proto *luaF_newproto (lua_State *L) {
   return f;
 }
 
+/* size of the vectors of prototype 'f' */
+static l_mem protoparts (Proto *f) {
+  return cast(l_mem, f->sizecode * sizeof(Instruction) +
+                     f->sizep * sizeof(Proto *) +
+                     f->sizek * sizeof(TValue) +
+                     f->sizelineinfo * sizeof(ls_byte) +
+                     f->sizeabslineinfo * sizeof(AbsLineInfo) +
+                     f->sizelocvars * sizeof(LocVar) +
+                     f->sizeupvalues * sizeof(Upvaldesc));
+}
+
+
+/*
+** Count the vectors of a complete prototype in the statistics of
+** kinds. (Prototypes left incomplete by an error are counted without
+** them, as their vectors were still growing.)
+*/
+void luaF_countproto (lua_State *L, Proto *f) {
+  luaC_kindbytes(G(L), LUA_GCKPROTO, protoparts(f));
+  f->counted = 1;
+}
+
+
 // 释放原型
 void luaF_freeproto (lua_State *L, Proto *f) {
+  if (f->counted)
+    luaC_kindbytes(G(L), LUA_GCKPROTO, -protoparts(f));
   luaM_freearray(L, f->code, f->sizecode);
   luaM_freearray(L, f->p, f->sizep);
   luaM_freearray(L, f->k, f->sizek);
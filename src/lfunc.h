@@ -54,6 +54,7 @@
 
 
 LUAI_FUNC Proto *luaF_newproto (lua_State *L);
+LUAI_FUNC void luaF_countproto (lua_State *L, Proto *f);
 LUAI_FUNC CClosure *luaF_newCclosure (lua_State *L, int nupvals);
 LUAI_FUNC LClosure *luaF_newLclosure (lua_State *L, int nupvals);
 LUAI_FUNC void luaF_initupvals (lua_State *L, LClosure *cl);
@@ -12,6 +12,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 
 #include "lua.h"
@@ -47,6 +48,26 @@
 #define GCFINALIZECOST	50
 
 
+/*
+** Monotonic clock, in microseconds, for the time budgets of the
+** collector.
+*/
+#if defined(LUA_USE_POSIX) && defined(CLOCK_MONOTONIC)
+
+static lu_mem gcclock (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return cast(lu_mem, ts.tv_sec) * 1000000 + cast(lu_mem, ts.tv_nsec / 1000);
+}
+
+#else
+
+#define gcclock()  \
+	cast(lu_mem, cast(double, clock()) * (1e6 / CLOCKS_PER_SEC))
+
+#endif
+
+
 /*
 ** The equivalent, in bytes, of one unit of "work" (visiting a slot,
 ** sweeping an object, etc.)
@@ -86,6 +107,17 @@
 #define keyiswhite(n)   (keyiscollectable(n) && iswhite(gckey(n)))
 
 
+/*
+** A thread is quiet when it is not running a function (it is idle,
+** suspended, or dead) and has no open upvalues, through which other
+** threads could change its stack.
+*/
+#define isquiet(th)  ((th)->openupval == NULL && \
+  ((th)->status != LUA_OK || (th)->ci == &(th)->base_ci))
+
+#define istouched(o)  (getage(o) == G_TOUCHED1 || getage(o) == G_TOUCHED2)
+
+
 /*
 ** Protected access to objects in values
 */
@@ -106,6 +138,8 @@
 #define markobjectN(g,t)	{ if (t) markobject(g,t); }
 
 static void reallymarkobject (global_State *g, GCObject *o);
+static void wakekey (global_State *g, GCObject *o);
+static void markallcards (Table *t);
 static lu_mem atomic (lua_State *L);
 static void entersweep (lua_State *L);
 
@@ -231,8 +265,12 @@ void luaC_barrier_ (lua_State *L, GCObject *o, GCObject *v) {
 void luaC_barrierback_ (lua_State *L, GCObject *o) {
   global_State *g = G(L);
   lua_assert(isblack(o) && !isdead(g, o));
-  lua_assert((g->gckind == KGC_GEN) == (isold(o) && getage(o) != G_TOUCHED1));
-  if (getage(o) == G_TOUCHED2)  /* already in gray list? */
+  lua_assert((g->gckind == KGC_GEN) == isold(o));
+  if (o->tt == LUA_VTABLE && gco2t(o)->cards != NULL &&
+      g->gckind == KGC_GEN)  /* table with cards? */
+    markallcards(gco2t(o));  /* its next stores will not be tracked */
+  /* (a black TOUCHED1 table has lost its cards; see 'luaC_resizecards') */
+  if (getage(o) == G_TOUCHED2 || getage(o) == G_TOUCHED1)  /* in list? */
     set2gray(o);  /* make it gray to become touched1 */
   else  /* link it in 'grayagain' and paint it gray */
     linkobjgclist(o, g->grayagain);
@@ -241,6 +279,311 @@ void luaC_barrierback_ (lua_State *L, GCObject *o) {
 }
 
 
+/*
+** {======================================================
+** Cards
+** =======================================================
+*/
+
+/*
+** In generational mode, the regular back barrier makes a whole old
+** table gray, so that the next minor collection traverses all of it,
+** twice. For big tables (at least CARDMIN slots), a store of a young
+** value marks instead the card of its slot, and the table stays black
+** (so that all its next stores go through the barrier, too) while
+** linked in 'grayagain'. Minor collections then traverse only the
+** cards marked in the current or in the previous cycle (a young value
+** stays young for two cycles) and age their marks. Whenever a table
+** with cards becomes gray or has its entries moved, all its cards are
+** marked, as the collector does not know where its young values are.
+*/
+
+/* minimum number of slots for a table to have cards */
+#define CARDMIN		(8 * CARDSIZE)
+
+#define istouched(o)	(getage(o) == G_TOUCHED1 || getage(o) == G_TOUCHED2)
+
+
+static void markallcards (Table *t) {
+  Cards *c = t->cards;
+  memset(c->card, CARDNEW | CARDOLD, c->n);
+}
+
+
+/*
+** Mark the card of 'slot', which must be an entry of table 't' (either
+** in its array or in its hash part).
+*/
+static void markcard (Table *t, const TValue *slot) {
+  Cards *c = t->cards;
+  unsigned int asize = luaH_realasize(t);
+  size_t i;
+  if (t->array <= slot && slot < t->array + asize)
+    i = cast_sizet(slot - t->array);
+  else
+    i = asize + cast_sizet(nodefromval(slot) - gnode(t, 0));
+  i /= CARDSIZE;
+  if (l_likely(i < c->n))
+    c->card[i] |= CARDNEW;
+  else  /* should not happen; be safe */
+    markallcards(t);
+}
+
+
+/*
+** Barrier for a store into 'slot' of table 't'. Only old tables with
+** cards that are not in a gray list for other reasons (OLD) or that
+** are already tracked by their cards (TOUCHED1, TOUCHED2) use the
+** cards; everything else goes through the regular back barrier.
+*/
+void luaC_barriertable_ (lua_State *L, Table *t, const TValue *slot) {
+  global_State *g = G(L);
+  if (t->cards != NULL && g->gckind == KGC_GEN &&
+      (getage(t) == G_OLD || istouched(t))) {
+    lua_assert(isblack(t));
+    markcard(t, slot);
+    if (getage(t) == G_OLD) {  /* not in a gray list? */
+      t->gclist = g->grayagain;  /* link it in 'grayagain'... */
+      g->grayagain = obj2gco(t);  /* ...keeping it black */
+    }
+    setage(t, G_TOUCHED1);  /* touched in current cycle */
+  }
+  else
+    luaC_barrierback_(L, obj2gco(t));
+}
+
+
+/*
+** Give table 't' cards for its new size, after a resize moved its
+** entries; 'old' are its previous cards (or NULL). A table already
+** touched may have young values anywhere, so all its new cards are
+** marked; other tables have no young values that cards must track.
+** Failing to allocate the cards is not an error: the table is then
+** traversed in full.
+*/
+void luaC_resizecards (lua_State *L, Table *t, Cards *old) {
+  size_t nslots = luaH_realasize(t) + cast_sizet(allocsizenode(t));
+  unsigned int n = cast_uint((nslots + CARDSIZE - 1) / CARDSIZE);
+  Cards *c;
+  if (nslots < CARDMIN)  /* table too small for cards? */
+    c = NULL;
+  else if (old != NULL && old->n == n)
+    c = old;  /* reuse previous cards */
+  else {
+    c = cast(Cards *, luaM_realloc_(L, NULL, 0, sizecards(n)));
+    if (c != NULL) {
+      c->n = n;
+      luaC_kindbytes(G(L), LUA_GCKTABLE, sizecards(n));
+    }
+  }
+  if (old != NULL && old != c) {
+    luaC_kindbytes(G(L), LUA_GCKTABLE, -cast(l_mem, sizecards(old->n)));
+    luaM_freemem(L, old, sizecards(old->n));
+  }
+  t->cards = c;
+  if (c != NULL) {
+    if (istouched(t))
+      markallcards(t);
+    else
+      memset(c->card, 0, n);
+  }
+}
+
+
+void luaC_freecards (lua_State *L, Table *t) {
+  if (t->cards != NULL) {
+    luaC_kindbytes(G(L), LUA_GCKTABLE, -cast(l_mem, sizecards(t->cards->n)));
+    luaM_freemem(L, t->cards, sizecards(t->cards->n));
+    t->cards = NULL;
+  }
+}
+
+
+/*
+** Traverse the marked cards of a touched table, aging their marks.
+*/
+static void traversecards (global_State *g, Table *h) {
+  Cards *c = h->cards;
+  unsigned int asize = luaH_realasize(h);
+  size_t nslots = asize + cast_sizet(allocsizenode(h));
+  unsigned int k;
+  for (k = 0; k < c->n; k++) {
+    if (c->card[k] != 0) {  /* card has young values? */
+      size_t i = cast_sizet(k) * CARDSIZE;
+      size_t lim = (i + CARDSIZE < nslots) ? i + CARDSIZE : nslots;
+      for (; i < lim; i++) {
+        if (i < asize) {  /* array part? */
+          markvalue(g, &h->array[i]);
+        }
+        else {  /* hash part */
+          Node *n = gnode(h, i - asize);
+          if (isempty(gval(n)))  /* entry is empty? */
+            clearkey(n);  /* clear its key */
+          else {
+            markkey(g, n);
+            markvalue(g, gval(n));
+          }
+        }
+      }
+      c->card[k] = cast_byte((c->card[k] << 1) & CARDOLD);  /* age marks */
+    }
+  }
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Pretenuring
+** =======================================================
+*/
+
+/*
+** In generational mode, each site (instruction) that creates tables or
+** closures watches a few of its objects, to learn whether they die
+** young or live to become old. Sites whose objects almost always become
+** old create them already old (black, with age G_OLD), so that minor
+** collections do not traverse them again and again while they age.
+** Like any old object, they only meet young objects through barriers.
+** These sites still create young one object in SITEOLDSAMPLE, to
+** watch it and notice if their objects start to die young.
+*/
+
+/* minimum number of known fates before a site can pretenure */
+#define SITEMINSAMPLES	8
+
+/* number of known fates above which they are halved, to forget old ones */
+#define SITEMAXSAMPLES	64
+
+/* maximum number of objects of a site watched at a time */
+#define SITEMAXPENDING	4
+
+/* a site creating old objects watches one of each SITEOLDSAMPLE objects */
+#define SITEOLDSAMPLE	16
+
+#define getsite(g,pc)  \
+	(&(g)->gcsites[lmod(point2uint(pc) >> 2, NALLOCSITES)])
+
+
+/*
+** Register the fate of a watched object from site 'pc'.
+*/
+static void sitefeedback (global_State *g, const Instruction *pc,
+                          int survived) {
+  AllocSite *s = getsite(g, pc);
+  if (s->pc != pc)  /* site replaced by another one? */
+    return;  /* feedback is lost */
+  s->pending--;
+  s->samples++;
+  s->survivors += cast_byte(survived);
+  if (s->samples >= SITEMAXSAMPLES) {
+    s->samples /= 2;
+    s->survivors /= 2;
+  }
+  s->old = (s->samples >= SITEMINSAMPLES &&
+            s->survivors >= s->samples - s->samples / 8);  /* 7/8 survived? */
+}
+
+
+/*
+** Stop watching the object in sample slot 'i'.
+*/
+static void freesample (global_State *g, int i, int survived) {
+  SiteSample *sp = &g->gcsamples[i];
+  resetbit(sp->o->marked, SAMPLEBIT);
+  sitefeedback(g, sp->pc, survived);
+  sp->o = NULL;
+  g->gcnsamples--;
+}
+
+
+/*
+** A watched object is being freed before it could become old.
+*/
+static void unsample (global_State *g, GCObject *o) {
+  int i;
+  for (i = 0; i < NSITESAMPLES; i++) {
+    if (g->gcsamples[i].o == o) {
+      freesample(g, i, 0);
+      return;
+    }
+  }
+  lua_assert(0);  /* watched objects must be in 'gcsamples' */
+}
+
+
+/*
+** After a minor collection, watched objects that are now old survived
+** (at least) two collections.
+*/
+static void checksamples (global_State *g) {
+  int i;
+  for (i = 0; g->gcnsamples > 0 && i < NSITESAMPLES; i++) {
+    GCObject *o = g->gcsamples[i].o;
+    if (o != NULL && isold(o))
+      freesample(g, i, 1);
+  }
+}
+
+
+/*
+** Stop watching all objects, without feedback. (Called when a major
+** collection makes all objects old, which tells nothing about sites.)
+*/
+static void clearsamples (global_State *g) {
+  int i;
+  for (i = 0; i < NSITESAMPLES; i++) {
+    SiteSample *sp = &g->gcsamples[i];
+    if (sp->o != NULL) {
+      AllocSite *s = getsite(g, sp->pc);
+      if (s->pc == sp->pc)
+        s->pending--;
+      resetbit(sp->o->marked, SAMPLEBIT);
+      sp->o = NULL;
+    }
+  }
+  g->gcnsamples = 0;
+}
+
+
+/*
+** Handle table or closure 'o', just created in generational mode by
+** the instruction 'pc': create it old or watch it, according to its
+** site. 'o' cannot refer yet to other objects, except through barriers.
+*/
+void luaC_allocsite_ (lua_State *L, GCObject *o, const Instruction *pc) {
+  global_State *g = G(L);
+  AllocSite *s = getsite(g, pc);
+  int canwatch;
+  lua_assert(g->gckind == KGC_GEN && getage(o) == G_NEW);
+  if (s->pc != pc) {  /* site not in the table? */
+    s->pc = pc;  /* replace previous one */
+    s->pending = s->samples = s->survivors = s->old = s->count = 0;
+  }
+  canwatch = (s->pending < SITEMAXPENDING && g->gcnsamples < NSITESAMPLES);
+  if (s->old && (!canwatch || ++s->count < SITEOLDSAMPLE)) {  /* old? */
+    o->marked = cast_byte((o->marked & ~maskgcbits) | bitmask(BLACKBIT) |
+                          G_OLD);
+    g->gcpretenured++;
+  }
+  else if (canwatch) {
+    int i = 0;
+    s->count = 0;
+    while (g->gcsamples[i].o != NULL)  /* look for a free slot */
+      i++;
+    g->gcsamples[i].o = o;
+    g->gcsamples[i].pc = pc;
+    g->gcnsamples++;
+    l_setbit(o->marked, SAMPLEBIT);
+    s->pending++;
+  }
+}
+
+/* }====================================================== */
+
+
 void luaC_fix (lua_State *L, GCObject *o) {
   global_State *g = G(L);
   lua_assert(g->allgc == o);  /* object must be 1st in 'allgc' list! */
@@ -252,6 +595,76 @@ void luaC_fix (lua_State *L, GCObject *o) {
 }
 
 
+/*
+** Objects with at least LUAI_LARGEOBJ bytes (only strings and userdata
+** can be that big) form the large-object space. Their memory counts in
+** 'lobytes' and not in the debt, so that a few big buffers do not pace
+** the collector as if they were thousands of small objects; only the
+** growth of the space beyond 'lolimit', set after each collection in
+** proportion to its size, adds to the debt. The allocation functions
+** already counted these blocks in the debt, so 'addlarge' and
+** 'removelarge' move them to 'totalbytes'.
+*/
+#define islargeobj(sz)	((sz) >= LUAI_LARGEOBJ)
+
+static void addlarge (global_State *g, size_t sz) {
+  l_mem charge = 0;  /* part of the block that goes to the debt */
+  g->lobytes += sz;
+  if (g->lobytes > g->lolimit) {  /* space above its limit? */
+    lu_mem excess = g->lobytes - g->lolimit;
+    charge = cast(l_mem, (excess < sz) ? excess : sz);
+  }
+  g->GCdebt -= cast(l_mem, sz) - charge;
+  g->totalbytes += cast(l_mem, sz) - charge;
+}
+
+
+static void removelarge (global_State *g, size_t sz) {
+  g->lobytes -= sz;
+  g->GCdebt += cast(l_mem, sz);  /* undo the credit of the deallocation */
+  g->totalbytes -= cast(l_mem, sz);
+}
+
+
+/*
+** An object of kind 'k' got a separate block with 'sz' bytes (already
+** counted in the debt), such as the contents of some long strings.
+*/
+void luaC_ownblock (lua_State *L, int k, size_t sz) {
+  global_State *g = G(L);
+  g->gcobjbytes[k] += sz;
+  if (l_unlikely(islargeobj(sz)))
+    addlarge(g, sz);
+}
+
+
+/*
+** Set the size of the large-object space above which its growth adds
+** to the debt: 'mul'% of its current size.
+*/
+static void setlolimit (global_State *g, int mul) {
+  g->lolimit = (g->lobytes / PAUSEADJ) * mul;
+}
+
+
+/*
+** Kind of an object for the statistics in 'gcobjs'/'gcobjbytes'
+*/
+static int objkind (int tt) {
+  switch (tt) {
+    case LUA_VTABLE: return LUA_GCKTABLE;
+    case LUA_VSHRSTR: return LUA_GCKSHRSTR;
+    case LUA_VLNGSTR: return LUA_GCKLNGSTR;
+    case LUA_VLCL: return LUA_GCKLCL;
+    case LUA_VCCL: return LUA_GCKCCL;
+    case LUA_VUSERDATA: return LUA_GCKUDATA;
+    case LUA_VTHREAD: return LUA_GCKTHREAD;
+    case LUA_VPROTO: return LUA_GCKPROTO;
+    default: lua_assert(tt == LUA_VUPVAL); return LUA_GCKUPVAL;
+  }
+}
+
+
 /*
 ** create a new collectable object (with given type and size) and link
 ** it to 'allgc' list.
@@ -259,6 +672,11 @@ void luaC_fix (lua_State *L, GCObject *o) {
 GCObject *luaC_newobj (lua_State *L, int tt, size_t sz) {
   global_State *g = G(L);
   GCObject *o = cast(GCObject *, luaM_newobject(L, novariant(tt), sz));
+  int k = objkind(tt);
+  if (l_unlikely(islargeobj(sz)))
+    addlarge(g, sz);
+  g->gcobjs[k]++;
+  g->gcobjbytes[k] += sz;
   o->marked = luaC_white(g);
   o->tt = tt;
   o->next = g->allgc;
@@ -279,7 +697,8 @@ GCObject *luaC_newobj (lua_State *L, int tt, size_t sz) {
 
 /*
 ** Mark an object.  Userdata with no user values, strings, and closed
-** upvalues are visited and turned black here.  Open upvalues are
+** upvalues are visited and turned black here (a slice also marks its
+** parent strings).  Open upvalues are
 ** already indirectly linked through their respective threads in the
 ** 'twups' list, so they don't go to the gray list; nevertheless, they
 ** are kept gray to avoid barriers, as their values will be revisited
@@ -290,12 +709,25 @@ GCObject *luaC_newobj (lua_State *L, int tt, size_t sz) {
 ** (only closures can), and a userdata's metatable must be a table.
 */
 static void reallymarkobject (global_State *g, GCObject *o) {
+  if (l_unlikely(g->ephemap != NULL))  /* converging ephemerons? */
+    wakekey(g, o);  /* 'o' may be a key of pending entries */
   switch (o->tt) {
-    case LUA_VSHRSTR:
-    case LUA_VLNGSTR: {
+    case LUA_VSHRSTR: {
       set2black(o);  /* nothing to visit */
       break;
     }
+    case LUA_VLNGSTR: {
+      TString *ts = gco2ts(o);
+      for (;;) {  /* mark the chain of parents without recursion */
+        set2black(ts);
+        ts = strparent(ts);
+        if (ts == NULL || !iswhite(ts))
+          break;
+        if (l_unlikely(g->ephemap != NULL))
+          wakekey(g, obj2gco(ts));
+      }
+      break;
+    }
     case LUA_VUPVAL: {
       UpVal *uv = gco2upv(o);
       if (upisopen(uv))
@@ -516,31 +948,50 @@ static int traverseephemeron (global_State *g, Table *h, int inv) {
 
 
 static void traversestrongtable (global_State *g, Table *h) {
-  Node *n, *limit = gnodelast(h);
-  unsigned int i;
-  unsigned int asize = luaH_realasize(h);
-  for (i = 0; i < asize; i++)  /* traverse array part */
-    markvalue(g, &h->array[i]);
-  for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
-    if (isempty(gval(n)))  /* entry is empty? */
-      clearkey(n);  /* clear its key */
-    else {
-      lua_assert(!keyisnil(n));
-      markkey(g, n);
-      markvalue(g, gval(n));
+  if (h->cards != NULL && g->gckind == KGC_GEN && istouched(h))
+    traversecards(g, h);  /* minor collection; traverse only dirty cards */
+  else {
+    Node *n, *limit = gnodelast(h);
+    unsigned int i;
+    unsigned int asize = luaH_realasize(h);
+    for (i = 0; i < asize; i++)  /* traverse array part */
+      markvalue(g, &h->array[i]);
+    for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
+      if (isempty(gval(n)))  /* entry is empty? */
+        clearkey(n);  /* clear its key */
+      else {
+        lua_assert(!keyisnil(n));
+        markkey(g, n);
+        markvalue(g, gval(n));
+      }
     }
   }
   genlink(g, obj2gco(h));
 }
 
 
+/*
+** Check whether the mode string 'mode' has the character 'c', looking
+** only up to its first '\0' (if any). ('mode' may be a slice, which is
+** not zero-terminated.)
+*/
+static int hasmode (TString *mode, int c) {
+  const char *s = getstr(mode);
+  size_t l = tsslen(mode);
+  const char *z = cast(const char *, memchr(s, '\0', l));
+  if (z != NULL)
+    l = cast_sizet(z - s);
+  return (memchr(s, c, l) != NULL);
+}
+
+
 static lu_mem traversetable (global_State *g, Table *h) {
-  const char *weakkey, *weakvalue;
+  int weakkey, weakvalue;
   const TValue *mode = gfasttm(g, h->metatable, TM_MODE);
   markobjectN(g, h->metatable);
   if (mode && ttisstring(mode) &&  /* is there a weak mode? */
-      (cast_void(weakkey = strchr(svalue(mode), 'k')),
-       cast_void(weakvalue = strchr(svalue(mode), 'v')),
+      (cast_void(weakkey = hasmode(tsvalue(mode), 'k')),
+       cast_void(weakvalue = hasmode(tsvalue(mode), 'v')),
        (weakkey || weakvalue))) {  /* is really weak? */
     if (!weakkey)  /* strong keys? */
       traverseweakvalue(g, h);
@@ -611,18 +1062,27 @@ static int traverseLclosure (global_State *g, LClosure *cl) {
 ** Traverse a thread, marking the elements in the stack up to its top
 ** and cleaning the rest of the stack in the final traversal. That
 ** ensures that the entire stack have valid (non-dead) objects.
-** Threads have no barriers. In gen. mode, old threads must be visited
-** at every cycle, because they might point to young objects.  In inc.
-** mode, the thread can still be modified before the end of the cycle,
-** and therefore it must be visited again in the atomic phase. To ensure
-** these visits, threads must return to a gray list if they are not new
-** (which can only happen in generational mode) or if the traverse is in
-** the propagate phase (which can only happen in incremental mode).
+** A thread that is running (or has open upvalues, which other threads
+** can change) has no barriers. In gen. mode, such old threads must be
+** visited at every cycle, because they might point to young objects.
+** In inc. mode, the thread can still be modified before the end of the
+** cycle, and therefore it must be visited again in the atomic phase.
+** To ensure these visits, threads must return to a gray list if they
+** are not new (which can only happen in generational mode) or if the
+** traverse is in the propagate phase (which can only happen in
+** incremental mode).
+** A quiet thread (see 'isquiet') can only change through the API or
+** by being resumed or called into, which all go through
+** 'luaC_threadbarrier'; so, it can stay black like any other object.
+** Its dead stack slice is cleared already, as it may not be visited
+** again in the atomic phase. In gen. mode, it stays in 'grayagain'
+** only while touched, so that its last contents become old.
 */
 static int traversethread (global_State *g, lua_State *th) {
   UpVal *uv;
   StkId o = th->stack;
-  if (isold(th) || g->gcstate == GCSpropagate)
+  int quiet = isquiet(th);
+  if (quiet ? istouched(th) : (isold(th) || g->gcstate == GCSpropagate))
     linkgclist(th, g->grayagain);  /* insert into 'grayagain' list */
   if (o == NULL)
     return 1;  /* stack not completely built yet */
@@ -632,9 +1092,11 @@ static int traversethread (global_State *g, lua_State *th) {
     markvalue(g, s2v(o));
   for (uv = th->openupval; uv != NULL; uv = uv->u.open.next)
     markobject(g, uv);  /* open upvalues cannot be collected */
-  if (g->gcstate == GCSatomic) {  /* final traversal? */
+  if (quiet || g->gcstate == GCSatomic) {  /* final traversal? */
     for (; o < th->stack_last + EXTRA_STACK; o++)
       setnilvalue(s2v(o));  /* clear dead stack slice */
+  }
+  if (g->gcstate == GCSatomic) {
     /* 'remarkupvals' may have removed thread from 'twups' list */
     if (!isintwups(th) && th->openupval != NULL) {
       th->twups = g->twups;  /* link it back to the list */
@@ -678,10 +1140,12 @@ static lu_mem propagateall (global_State *g) {
 ** Traverse all ephemeron tables propagating marks from keys to values.
 ** Repeat until it converges, that is, nothing new is marked. 'dir'
 ** inverts the direction of the traversals, trying to speed up
-** convergence on chains in the same table.
-**
+** convergence on chains in the same table. (This is only a fallback
+** for 'convergeephemerons', used when it cannot allocate memory for
+** its map; each round may mark a single new value, so this loop can
+** take quadratic time.)
 */
-static void convergeephemerons (global_State *g) {
+static void iterateephemerons (global_State *g) {
   int changed;
   int dir = 0;
   do {
@@ -702,6 +1166,207 @@ static void convergeephemerons (global_State *g) {
   } while (changed);  /* repeat until no more changes */
 }
 
+
+/*
+** Instead of traversing the ephemeron tables until nothing changes,
+** the collector keeps a map from each white key to the white values
+** that depend on it ("pending" entries). Marking a key with pending
+** entries ('reallymarkobject', while 'g->ephemap' is set) moves them
+** to a list of "woken" entries, whose values are marked next. So, each
+** entry is handled a constant number of times. The map lives only
+** during the convergence, outside the accounting of the collector.
+*/
+
+typedef struct EphKey {
+  GCObject *key;  /* NULL if slot is free */
+  int first;  /* first pending value for this key (-1 if none) */
+} EphKey;
+
+
+typedef struct EphValue {
+  GCObject *value;
+  int next;  /* next entry in the same list (-1 if none) */
+} EphValue;
+
+
+typedef struct EphMap {
+  EphKey *keys;  /* open-addressing hash of keys */
+  EphValue *values;  /* pending values, linked by key */
+  int sizekeys;  /* size of 'keys' (0 or a power of 2) */
+  int nkeys;  /* number of keys in use */
+  int sizevalues;  /* size of 'values' */
+  int nvalues;  /* number of values in use */
+  int woken;  /* list of values whose keys were marked (-1 if empty) */
+  int failed;  /* true if some allocation failed */
+} EphMap;
+
+
+#define hashkey(k,size)	lmod(point2uint(k) * 2654435769u >> 8, size)
+
+
+/* find the slot of key 'k', or the free slot where it should go */
+static EphKey *findkey (EphMap *m, GCObject *k) {
+  int i = hashkey(k, m->sizekeys);
+  while (m->keys[i].key != k && m->keys[i].key != NULL)
+    i = lmod(i + 1, m->sizekeys);  /* linear probing */
+  return &m->keys[i];
+}
+
+
+static int growkeys (global_State *g, EphMap *m) {
+  int oldsize = m->sizekeys;
+  EphKey *old = m->keys;
+  int size = (oldsize > 0) ? oldsize * 2 : 64;
+  int i;
+  if (size > MAX_INT / cast_int(sizeof(EphKey)))
+    return 0;
+  m->keys = cast(EphKey *,
+                 (*g->frealloc)(g->ud, NULL, 0, size * sizeof(EphKey)));
+  if (m->keys == NULL) {
+    m->keys = old;
+    return 0;
+  }
+  m->sizekeys = size;
+  for (i = 0; i < size; i++)
+    m->keys[i].key = NULL;
+  for (i = 0; i < oldsize; i++) {  /* reinsert old keys */
+    if (old[i].key != NULL)
+      *findkey(m, old[i].key) = old[i];
+  }
+  (*g->frealloc)(g->ud, old, oldsize * sizeof(EphKey), 0);
+  return 1;
+}
+
+
+static int growvalues (global_State *g, EphMap *m) {
+  int size = (m->sizevalues > 0) ? m->sizevalues * 2 : 64;
+  EphValue *values;
+  if (size > MAX_INT / cast_int(sizeof(EphValue)))
+    return 0;
+  values = cast(EphValue *, (*g->frealloc)(g->ud, m->values,
+                 m->sizevalues * sizeof(EphValue), size * sizeof(EphValue)));
+  if (values == NULL)
+    return 0;
+  m->values = values;
+  m->sizevalues = size;
+  return 1;
+}
+
+
+/*
+** Add a pending entry 'k' -> 'v'. After a failure, the map is no
+** longer used; the collector falls back to 'iterateephemerons'.
+*/
+static void addpending (global_State *g, EphMap *m, GCObject *k,
+                                                   GCObject *v) {
+  EphKey *slot;
+  if (m->failed)
+    return;
+  if ((m->nkeys + 1 > (m->sizekeys >> 1) + (m->sizekeys >> 2) &&
+       !growkeys(g, m)) ||
+      (m->nvalues == m->sizevalues && !growvalues(g, m))) {
+    m->failed = 1;
+    return;
+  }
+  slot = findkey(m, k);
+  if (slot->key == NULL) {  /* new key? */
+    slot->key = k;
+    slot->first = -1;
+    m->nkeys++;
+  }
+  m->values[m->nvalues].value = v;
+  m->values[m->nvalues].next = slot->first;
+  slot->first = m->nvalues++;
+}
+
+
+/*
+** Object 'o' is being marked; move its pending values (if any) to the
+** list of woken values.
+*/
+static void wakekey (global_State *g, GCObject *o) {
+  EphMap *m = g->ephemap;
+  EphKey *slot;
+  int i;
+  if (m->nkeys == 0)
+    return;
+  slot = findkey(m, o);
+  if (slot->key == NULL || slot->first < 0)
+    return;  /* no pending values */
+  for (i = slot->first; m->values[i].next >= 0; i = m->values[i].next)
+    ;  /* find last pending value of this key */
+  m->values[i].next = m->woken;
+  m->woken = slot->first;
+  slot->first = -1;
+}
+
+
+/*
+** Mark values of marked keys in ephemeron table 'h', and add its
+** white-key -> white-value entries to the map. Returns true if the
+** table has white keys.
+*/
+static int scanephemeron (global_State *g, EphMap *m, Table *h) {
+  int hasclears = 0;
+  Node *n, *limit = gnodelast(h);
+  for (n = gnode(h, 0); n < limit; n++) {
+    if (isempty(gval(n)))  /* entry is empty? */
+      continue;
+    else if (iscleared(g, gckeyN(n))) {  /* key is not marked (yet)? */
+      hasclears = 1;
+      if (valiswhite(gval(n)))  /* value not marked yet? */
+        addpending(g, m, gckeyN(n), gcvalue(gval(n)));
+    }
+    else if (valiswhite(gval(n)))  /* value not marked yet? */
+      reallymarkobject(g, gcvalue(gval(n)));  /* mark it now */
+  }
+  return hasclears;
+}
+
+
+/*
+** Propagate marks from keys to values in all ephemeron tables, until
+** nothing new is marked. Tables reaching 'g->ephemeron' (during the
+** propagations) are scanned once; at the end, tables with white keys
+** are back in 'g->ephemeron', to be cleared.
+*/
+static void convergeephemerons (global_State *g) {
+  EphMap m;
+  GCObject *withclears = NULL;  /* tables with white keys */
+  m.keys = NULL; m.values = NULL;
+  m.sizekeys = m.nkeys = m.sizevalues = m.nvalues = 0;
+  m.woken = -1;
+  m.failed = 0;
+  g->ephemap = &m;
+  for (;;) {
+    GCObject *w;
+    propagateall(g);
+    if (g->ephemeron == NULL && m.woken < 0)
+      break;  /* converged */
+    while ((w = g->ephemeron) != NULL) {  /* scan new tables */
+      Table *h = gco2t(w);
+      g->ephemeron = h->gclist;
+      nw2black(h);  /* out of the list (for now) */
+      if (scanephemeron(g, &m, h))
+        linkgclist(h, withclears);
+      else
+        genlink(g, obj2gco(h));
+    }
+    while (m.woken >= 0) {  /* mark woken values */
+      GCObject *v = m.values[m.woken].value;
+      m.woken = m.values[m.woken].next;
+      if (iswhite(v))
+        reallymarkobject(g, v);
+    }
+  }
+  g->ephemap = NULL;
+  g->ephemeron = withclears;
+  (*g->frealloc)(g->ud, m.keys, m.sizekeys * sizeof(EphKey), 0);
+  (*g->frealloc)(g->ud, m.values, m.sizevalues * sizeof(EphValue), 0);
+  if (m.failed)  /* map is incomplete? */
+    iterateephemerons(g);  /* use the old method */
+}
+
 /* }====================================================== */
 
 
@@ -763,47 +1428,81 @@ static void freeupval (lua_State *L, UpVal *uv) {
 
 
 static void freeobj (lua_State *L, GCObject *o) {
+  global_State *g = G(L);
+  int k = objkind(o->tt);
+  size_t sz;  /* size of the object itself (its parts count apart) */
+  if (l_unlikely(testbit(o->marked, SAMPLEBIT)))
+    unsample(g, o);
   switch (o->tt) {
     case LUA_VPROTO:
       luaF_freeproto(L, gco2p(o));
+      sz = sizeof(Proto);
       break;
     case LUA_VUPVAL:
       freeupval(L, gco2upv(o));
+      sz = sizeof(UpVal);
       break;
     case LUA_VLCL: {
       LClosure *cl = gco2lcl(o);
-      luaM_freemem(L, cl, sizeLclosure(cl->nupvalues));
+      sz = sizeLclosure(cl->nupvalues);
+      luaM_freemem(L, cl, sz);
       break;
     }
     case LUA_VCCL: {
       CClosure *cl = gco2ccl(o);
-      luaM_freemem(L, cl, sizeCclosure(cl->nupvalues));
+      sz = sizeCclosure(cl->nupvalues);
+      luaM_freemem(L, cl, sz);
       break;
     }
     case LUA_VTABLE:
       luaH_free(L, gco2t(o));
+      sz = sizeof(Table);
       break;
     case LUA_VTHREAD:
       luaE_freethread(L, gco2th(o));
+      sz = 0;  /* 'luaE_freethread' uncounts all its memory */
       break;
     case LUA_VUSERDATA: {
       Udata *u = gco2u(o);
-      luaM_freemem(L, o, sizeudata(u->nuvalue, u->len));
+      sz = sizeudata(u->nuvalue, u->len);
+      luaM_freemem(L, o, sz);
+      if (l_unlikely(islargeobj(sz)))
+        removelarge(g, sz);
       break;
     }
     case LUA_VSHRSTR: {
       TString *ts = gco2ts(o);
+      sz = sizelstring(ts->shrlen);
       luaS_remove(L, ts);  /* remove it from hash table */
-      luaM_freemem(L, ts, sizelstring(ts->shrlen));
+      luaM_freemem(L, ts, sz);
       break;
     }
     case LUA_VLNGSTR: {
       TString *ts = gco2ts(o);
-      luaM_freemem(L, ts, sizelstring(ts->u.lnglen));
+      if (l_likely(!strisext(ts)))
+        sz = sizelstring(ts->u.lnglen);
+      else {
+        sz = sizestrref;
+        if (ts->shrlen == LSTRMEM) {  /* free its copy of the contents */
+          size_t l = ts->u.lnglen + 1;
+          luaM_freearray(L, tsref(ts)->s, l);
+          g->gcobjbytes[k] -= l * sizeof(char);
+          if (l_unlikely(islargeobj(l * sizeof(char))))
+            removelarge(g, l * sizeof(char));
+        }
+        else if (ts->shrlen == LSTREXT && tsref(ts)->u.ext.falloc != NULL)
+          (*tsref(ts)->u.ext.falloc)(tsref(ts)->u.ext.ud, tsref(ts)->s,
+                                     ts->u.lnglen + 1, 0);  /* give it back */
+      }
+      luaM_freemem(L, ts, sz);
+      if (l_unlikely(islargeobj(sz)))
+        removelarge(g, sz);
       break;
     }
-    default: lua_assert(0);
+    default: lua_assert(0); return;
   }
+  g->gcobjs[k]--;
+  g->gcobjbytes[k] -= sz;
 }
 
 
@@ -863,7 +1562,7 @@ static GCObject **sweeptolive (lua_State *L, GCObject **p) {
 */
 static void checkSizes (lua_State *L, global_State *g) {
   if (!g->gcemergency) {
-    if (g->strt.nuse < g->strt.size / 4) {  /* string table too big? */
+    if (g->strt.nuse < strtslots(&g->strt) / 4) {  /* table too big? */
       l_mem olddebt = g->GCdebt;
       luaS_resize(L, g->strt.size / 2);
       g->GCestimate += g->GCdebt - olddebt;  /* correct estimate */
@@ -880,6 +1579,8 @@ static GCObject *udata2finalize (global_State *g) {
   GCObject *o = g->tobefnz;  /* get first element */
   lua_assert(tofinalize(o));
   g->tobefnz = o->next;  /* remove it from 'tobefnz' list */
+  g->gcfinpending--;
+  g->gcfinalized++;
   o->next = g->allgc;  /* return it to 'allgc' list */
   g->allgc = o;
   resetbit(o->marked, FINALIZEDBIT);  /* object is "normal" again */
@@ -937,6 +1638,23 @@ static int runafewfinalizers (lua_State *L, int n) {
 }
 
 
+/*
+** Call finalizers until there are no more pending finalizers or the
+** clock passes 'deadline', but always at least one, so that pending
+** finalizers make progress even when the collection work has used up
+** the time. Returns the number of finalizers called.
+*/
+static int runfinalizersuntil (lua_State *L, lu_mem deadline) {
+  global_State *g = G(L);
+  int n = 0;
+  while (g->tobefnz && (n == 0 || gcclock() < deadline)) {
+    GCTM(L);
+    n++;
+  }
+  return n;
+}
+
+
 /*
 ** call all pending finalizers
 */
@@ -976,6 +1694,7 @@ static void separatetobefnz (global_State *g, int all) {
       if (curr == g->finobjsur)  /* removing 'finobjsur'? */
         g->finobjsur = curr->next;  /* correct it */
       *p = curr->next;  /* remove 'curr' from 'finobj' list */
+      g->gcfinpending++;
       curr->next = *lastnext;  /* link at the end of 'tobefnz' list */
       *lastnext = curr;
       lastnext = &curr->next;
@@ -1043,6 +1762,7 @@ void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt) {
 */
 
 static void setpause (global_State *g);
+static void checksoftlimit (global_State *g);
 
 
 /*
@@ -1140,9 +1860,11 @@ static void whitelist (global_State *g, GCObject *p) {
 ** list should be linked.
 ** Because this correction is done after sweeping, young objects might
 ** be turned white and still be in the list. They are only removed.
+** Non-white threads that are not quiet remain on the list, as touched
+** (so that they need two more cycles to leave it once they get quiet);
 ** 'TOUCHED1' objects are advanced to 'TOUCHED2' and remain on the list;
-** Non-white threads also remain on the list; 'TOUCHED2' objects become
-** regular old; they and anything else are removed from the list.
+** 'TOUCHED2' objects become regular old; they and anything else are
+** removed from the list.
 */
 static GCObject **correctgraylist (GCObject **p) {
   GCObject *curr;
@@ -1150,16 +1872,17 @@ static GCObject **correctgraylist (GCObject **p) {
     GCObject **next = getgclist(curr);
     if (iswhite(curr))
       goto remove;  /* remove all white objects */
+    else if (curr->tt == LUA_VTHREAD && !isquiet(gco2th(curr))) {
+      lua_assert(isgray(curr) && isold(curr));
+      setage(curr, G_TOUCHED1);
+      goto remain;  /* keep active threads on the list */
+    }
     else if (getage(curr) == G_TOUCHED1) {  /* touched in this cycle? */
       lua_assert(isgray(curr));
       nw2black(curr);  /* make it black, for next barrier */
       changeage(curr, G_TOUCHED1, G_TOUCHED2);
       goto remain;  /* keep it in the list and go to next element */
     }
-    else if (curr->tt == LUA_VTHREAD) {
-      lua_assert(isgray(curr));
-      goto remain;  /* keep non-white threads on the list */
-    }
     else {  /* everything else is removed */
       lua_assert(isold(curr));  /* young objects should be white here */
       if (getage(curr) == G_TOUCHED2)  /* advance from TOUCHED2... */
@@ -1213,7 +1936,11 @@ static void finishgencycle (lua_State *L, global_State *g) {
   correctgraylists(g);
   checkSizes(L, g);
   g->gcstate = GCSpropagate;  /* skip restart */
-  if (!g->gcemergency)
+  if (g->gcemergency)
+    return;  /* no finalizers now */
+  else if (g->gcfindeadline != 0)  /* time budget for this step? */
+    return;  /* the step runs them after the collection ('genfinalizers') */
+  else
     callallpendingfinalizers(L);
 }
 
@@ -1234,6 +1961,7 @@ static void youngcollection (lua_State *L, global_State *g) {
   markold(g, g->finobj, g->finobjrold);
   markold(g, g->tobefnz, NULL);
   atomic(L);
+  g->gcminors++;
 
   /* sweep nursery and get a pointer to its last live element */
   g->gcstate = GCSswpallgc;
@@ -1254,6 +1982,7 @@ static void youngcollection (lua_State *L, global_State *g) {
   g->finobjsur = g->finobj;  /* all news are survivals */
 
   sweepgen(L, g, &g->tobefnz, NULL, &dummy);
+  checksamples(g);
   finishgencycle(L, g);
 }
 
@@ -1278,10 +2007,12 @@ static void atomic2gen (lua_State *L, global_State *g) {
   g->finobjrold = g->finobjold1 = g->finobjsur = g->finobj;
 
   sweep2old(L, &g->tobefnz);
+  clearsamples(g);
 
   g->gckind = KGC_GEN;
   g->lastatomic = 0;
-  g->GCestimate = gettotalbytes(g);  /* base for memory control */
+  g->GCestimate = getheapbytes(g);  /* base for memory control */
+  setlolimit(g, PAUSEADJ + getgcparam(g->genmajormul));
   finishgencycle(L, g);
 }
 
@@ -1348,7 +2079,111 @@ static lu_mem fullgen (lua_State *L, global_State *g) {
 ** memory grows 'genminormul'%.
 */
 static void setminordebt (global_State *g) {
-  luaE_setdebt(g, -(cast(l_mem, (gettotalbytes(g) / 100)) * g->genminormul));
+  luaE_setdebt(g, -(cast(l_mem, (getheapbytes(g) / 100)) * g->genminormul));
+  checksoftlimit(g);
+}
+
+
+/*
+** In adaptive mode, each collection votes either for the current mode
+** or for a switch, and the collector switches modes only after some
+** consecutive votes for a switch ('gcadaptneed'). That number doubles
+** after each switch, so that a program on the edge between the modes
+** does not keep switching back and forth; it halves again after each
+** run of as many collections confirming the current mode.
+**
+** In generational mode, a minor collection votes for a switch when
+** most of the young memory survives it, and a major collection votes
+** for a switch when it is a bad collection (see 'stepgenfull'). In
+** incremental mode, a cycle votes for a switch when memory in use
+** after it did not grow more than 1/8 since the previous cycle:
+** then most allocated objects were garbage, which is the case that
+** minor collections handle well.
+*/
+
+/* initial number of votes needed to switch modes */
+#define ADAPTVOTES	3
+
+/* maximum number of votes needed to switch modes */
+#define MAXADAPTVOTES	(ADAPTVOTES << 3)
+
+/* a minor collection keeping more than this % of young memory is bad */
+#define ADAPTSURVIVAL	50
+
+
+/* reasons for automatic switches (NULL is a vote for current mode) */
+static const char highsurvival[] = "minor collections kept most young memory";
+static const char badmajor[] = "major collections freed too little memory";
+static const char stableheap[] = "memory in use stable across cycles";
+
+
+/*
+** Count the vote of a collection; 'reason' is NULL for a vote for the
+** current mode. Returns true if the collector must switch modes.
+*/
+static int adaptvote (global_State *g, const char *reason) {
+  if (!g->gcadaptive)
+    return 0;
+  g->gcadaptbase = getheapbytes(g);
+  if (reason == NULL) {
+    g->gcvotes = 0;
+    if (++g->gcconfirms >= g->gcadaptneed) {
+      g->gcconfirms = 0;
+      if (g->gcadaptneed > ADAPTVOTES)
+        g->gcadaptneed /= 2;
+    }
+    return 0;
+  }
+  g->gcconfirms = 0;
+  if (++g->gcvotes < g->gcadaptneed)
+    return 0;
+  g->gcvotes = 0;
+  if (g->gcadaptneed < MAXADAPTVOTES)
+    g->gcadaptneed *= 2;
+  g->gcswitches++;
+  g->gclastswitch = reason;
+  return 1;
+}
+
+
+/*
+** Vote of a minor collection, given the memory in use before it.
+** Memory allocated and kept since the previous collection is measured
+** from the memory in use after that collection ('gcadaptbase').
+*/
+static const char *minorvote (global_State *g, lu_mem before) {
+  lu_mem base = g->gcadaptbase;
+  lu_mem after = getheapbytes(g);
+  if (before <= base)  /* no young memory? */
+    return NULL;
+  else if (after > base &&
+           after - base > ((before - base) / 100) * ADAPTSURVIVAL)
+    return highsurvival;
+  else
+    return NULL;
+}
+
+
+/*
+** Vote at the end of an incremental cycle, after 'GCestimate' has its
+** final value. Returns true if the collector must switch modes.
+*/
+static int incvote (global_State *g) {
+  lu_mem base = g->gcadaptbase;
+  return adaptvote(g, (g->GCestimate <= base + (base >> 3)) ? stableheap
+                                                            : NULL);
+}
+
+
+/*
+** Turn adaptive mode on or off.
+*/
+void luaC_adaptive (lua_State *L, int on) {
+  global_State *g = G(L);
+  g->gcadaptive = cast_byte(on);
+  g->gcvotes = g->gcconfirms = 0;
+  g->gcadaptneed = ADAPTVOTES;
+  g->gcadaptbase = getheapbytes(g);
 }
 
 
@@ -1383,13 +2218,15 @@ static void stepgenfull (lua_State *L, global_State *g) {
   if (newatomic < lastatomic + (lastatomic >> 3)) {  /* good collection? */
     atomic2gen(L, g);  /* return to generational mode */
     setminordebt(g);
+    adaptvote(g, NULL);
   }
   else {  /* another bad collection; stay in incremental mode */
-    g->GCestimate = gettotalbytes(g);  /* first estimate */;
+    g->GCestimate = getheapbytes(g);  /* first estimate */;
     entersweep(L);
     luaC_runtilstate(L, bitmask(GCSpause));  /* finish collection */
     setpause(g);
-    g->lastatomic = newatomic;
+    /* in adaptive mode, may stay in incremental mode for good */
+    g->lastatomic = adaptvote(g, badmajor) ? 0 : newatomic;
   }
 }
 
@@ -1419,12 +2256,18 @@ static void genstep (lua_State *L, global_State *g) {
   else {
     lu_mem majorbase = g->GCestimate;  /* memory after last major collection */
     lu_mem majorinc = (majorbase / 100) * getgcparam(g->genmajormul);
-    if (g->GCdebt > 0 && gettotalbytes(g) > majorbase + majorinc) {
+    if (g->GCdebt > 0 && (getheapbytes(g) > majorbase + majorinc ||
+                          g->lobytes > g->lolimit)) {
       lu_mem numobjs = fullgen(L, g);  /* do a major collection */
-      if (gettotalbytes(g) < majorbase + (majorinc / 2)) {
+      if (getheapbytes(g) < majorbase + (majorinc / 2)) {
         /* collected at least half of memory growth since last major
            collection; keep doing minor collections */
         setminordebt(g);
+        adaptvote(g, NULL);
+      }
+      else if (adaptvote(g, badmajor)) {  /* switch to incremental mode? */
+        enterinc(g);
+        setpause(g);
       }
       else {  /* bad collection */
         g->lastatomic = numobjs;  /* signal that last collection was bad */
@@ -1432,12 +2275,20 @@ static void genstep (lua_State *L, global_State *g) {
       }
     }
     else {  /* regular case; do a minor collection */
+      lu_mem before = getheapbytes(g);
       youngcollection(L, g);
-      setminordebt(g);
-      g->GCestimate = majorbase;  /* preserve base value */
+      if (adaptvote(g, minorvote(g, before))) {  /* switch modes? */
+        enterinc(g);
+        g->GCestimate = getheapbytes(g);
+        setpause(g);
+      }
+      else {
+        setminordebt(g);
+        g->GCestimate = majorbase;  /* preserve base value */
+      }
     }
   }
-  lua_assert(isdecGCmodegen(g));
+  lua_assert(isdecGCmodegen(g) || g->gcadaptive);
 }
 
 /* }====================================================== */
@@ -1464,9 +2315,31 @@ static void setpause (global_State *g) {
   threshold = (pause < MAX_LMEM / estimate)  /* overflow? */
             ? estimate * pause  /* no overflow */
             : MAX_LMEM;  /* overflow; truncate to maximum */
-  debt = gettotalbytes(g) - threshold;
+  if (g->memsoftlimit != 0) {  /* do not wait beyond the soft limit */
+    l_mem room = (g->memsoftlimit > g->lobytes)
+               ? cast(l_mem, g->memsoftlimit - g->lobytes)
+               : 0;  /* large objects alone are above the limit */
+    if (threshold > room)
+      threshold = room;
+  }
+  debt = getheapbytes(g) - threshold;
   if (debt > 0) debt = 0;
   luaE_setdebt(g, debt);
+  setlolimit(g, pause);
+  checksoftlimit(g);
+}
+
+
+/*
+** After a collection, if memory in use went back below the soft limit,
+** re-arm the limit so that the next crossing is signaled again. (While
+** above the limit, 'setpause' keeps starting new cycles right away.)
+*/
+static void checksoftlimit (global_State *g) {
+  if (g->memsoftsignaled && gettotalbytes(g) < g->memsoftlimit) {
+    g->memsoftsignaled = 0;
+    luaE_setmemcheck(g);
+  }
 }
 
 
@@ -1555,6 +2428,8 @@ static lu_mem atomic (lua_State *L) {
   luaS_clearcache(g);
   g->currentwhite = cast_byte(otherwhite(g));  /* flip current white */
   lua_assert(g->gray == NULL);
+  if (g->gckind == KGC_INC)  /* not a minor collection? */
+    g->gccycles++;
   return work;  /* estimate of slots marked by 'atomic' */
 }
 
@@ -1600,7 +2475,7 @@ static lu_mem singlestep (lua_State *L) {
     case GCSenteratomic: {
       work = atomic(L);  /* work is what was traversed by 'atomic' */
       entersweep(L);
-      g->GCestimate = gettotalbytes(g);  /* first estimate */;
+      g->GCestimate = getheapbytes(g);  /* first estimate */;
       break;
     }
     case GCSswpallgc: {  /* sweep "regular" objects */
@@ -1624,7 +2499,11 @@ static lu_mem singlestep (lua_State *L) {
     case GCScallfin: {  /* call remaining finalizers */
       if (g->tobefnz && !g->gcemergency) {
         g->gcstopem = 0;  /* ok collections during finalizers */
-        work = runafewfinalizers(L, GCFINMAX) * GCFINALIZECOST;
+        if (g->gcfindeadline != 0) {  /* time budget for this step? */
+          work = runfinalizersuntil(L, g->gcfindeadline) * GCFINALIZECOST;
+        }
+        else
+          work = runafewfinalizers(L, GCFINMAX) * GCFINALIZECOST;
       }
       else {  /* emergency mode or no more finalizers */
         g->gcstate = GCSpause;  /* finish collection */
@@ -1645,12 +2524,29 @@ static lu_mem singlestep (lua_State *L) {
 */
 void luaC_runtilstate (lua_State *L, int statesmask) {
   global_State *g = G(L);
+  lu_mem deadline = g->gcfindeadline;
+  g->gcfindeadline = 0;  /* a time budget could stall 'GCScallfin' */
   while (!testbit(statesmask, g->gcstate))
     singlestep(L);
+  g->gcfindeadline = deadline;
 }
 
 
 
+/*
+** Settle the collector after an incremental cycle: either switch to
+** generational mode (in adaptive mode) or pause until the next cycle.
+*/
+static void endinccycle (lua_State *L, global_State *g) {
+  if (incvote(g)) {  /* adaptive mode wants to switch to generational? */
+    entergen(L, g);
+    setminordebt(g);
+  }
+  else
+    setpause(g);  /* pause until next cycle */
+}
+
+
 /*
 ** Performs a basic incremental step. The debt and step size are
 ** converted from bytes to "units of work"; then the function loops
@@ -1668,8 +2564,8 @@ static void incstep (lua_State *L, global_State *g) {
     lu_mem work = singlestep(L);  /* perform one single step */
     debt -= work;
   } while (debt > -stepsize && g->gcstate != GCSpause);
-  if (g->gcstate == GCSpause)
-    setpause(g);  /* pause until next cycle */
+  if (g->gcstate == GCSpause)  /* end of cycle? */
+    endinccycle(L, g);
   else {
     debt = (debt / stepmul) * WORK2MEM;  /* convert 'work units' to bytes */
     luaE_setdebt(g, debt);
@@ -1677,20 +2573,94 @@ static void incstep (lua_State *L, global_State *g) {
 }
 
 /*
-** performs a basic GC step if collector is running
+** In generational mode, with a time budget, 'finishgencycle' leaves
+** the finalizers to the step, which calls them after the collection
+** until 'deadline'.
+*/
+static void genfinalizers (lua_State *L, global_State *g, lu_mem deadline) {
+  if (g->tobefnz && isdecGCmodegen(g))
+    runfinalizersuntil(L, deadline);
+}
+
+
+/*
+** performs a basic GC step if collector is running. With a time budget
+** for finalizers, finalizers run in this step only until the deadline
+** ('gcfindeadline'); the remaining ones wait for the next steps. In
+** generational mode, the budget starts after the collection, which
+** can easily take longer than the whole budget.
 */
 void luaC_step (lua_State *L) {
   global_State *g = G(L);
   lua_assert(!g->gcemergency);
   if (gcrunning(g)) {  /* running? */
+    if (g->gcfinbudget != 0)
+      g->gcfindeadline = gcclock() + g->gcfinbudget;
     if(isdecGCmodegen(g))
       genstep(L, g);
     else
-      incstep(L, g);
+      incstep(L, g);  /* (it may switch to generational mode) */
+    if (g->gcfindeadline != 0)
+      genfinalizers(L, g, gcclock() + g->gcfinbudget);
+    g->gcfindeadline = 0;
   }
 }
 
 
+/*
+** Performs collector work for about 'usec' microseconds (at least one
+** basic step), e.g., while the application is idle. In incremental
+** mode, does basic steps until the deadline or the end of the cycle,
+** and credits the work done to the debt, so that it is not repeated by
+** the steps driven by allocation. In generational mode, does a whole
+** generational step, as they are indivisible. Returns true if it
+** finished a cycle.
+*/
+int luaC_stepfor (lua_State *L, lu_mem usec) {
+  global_State *g = G(L);
+  lu_mem deadline = gcclock() + usec;
+  if (isdecGCmodegen(g)) {
+    g->gcfindeadline = deadline;
+    genstep(L, g);
+    genfinalizers(L, g, deadline);
+    g->gcfindeadline = 0;
+    return 1;
+  }
+  else {
+    int stepmul = (getgcparam(g->gcstepmul) | 1);  /* avoid division by 0 */
+    lu_mem work = 0;
+    g->gcfindeadline = deadline;  /* finalizers also respect the deadline */
+    do {
+      work += singlestep(L);
+    } while (g->gcstate != GCSpause && gcclock() < deadline);
+    g->gcfindeadline = 0;
+    if (g->gcstate == GCSpause) {  /* end of cycle? */
+      endinccycle(L, g);
+      return 1;
+    }
+    else {  /* convert 'work units' to bytes and pay them off the debt */
+      l_mem credit = cast(l_mem, (work / stepmul) * WORK2MEM);
+      luaE_setdebt(g, g->GCdebt - credit);
+      return 0;
+    }
+  }
+}
+
+
+/*
+** Call pending finalizers for up to 'usec' microseconds (at least one;
+** all of them, if 'usec' is zero). Returns the number of finalizers still pending.
+*/
+lu_mem luaC_runfinalizers (lua_State *L, lu_mem usec) {
+  global_State *g = G(L);
+  if (usec == 0)
+    callallpendingfinalizers(L);
+  else
+    runfinalizersuntil(L, gcclock() + usec);
+  return g->gcfinpending;
+}
+
+
 /*
 ** Perform a full collection in incremental mode.
 ** Before running the collection, check 'keepinvariant'; if it is true,
@@ -1705,7 +2675,7 @@ static void fullinc (lua_State *L, global_State *g) {
   luaC_runtilstate(L, bitmask(GCSpause));
   luaC_runtilstate(L, bitmask(GCScallfin));  /* run up to finalizers */
   /* estimate must be correct after a full GC cycle */
-  lua_assert(g->GCestimate == gettotalbytes(g));
+  lua_assert(g->GCestimate == getheapbytes(g));
   luaC_runtilstate(L, bitmask(GCSpause));  /* finish collection */
   setpause(g);
 }
@@ -1730,3 +2700,458 @@ void luaC_fullgc (lua_State *L, int isemergency) {
 /* }====================================================== */
 
 
+
+/*
+** {======================================================
+** Allocation regions
+** =======================================================
+*/
+
+
+/*
+** Open an allocation region. A region brackets a burst of work (e.g.,
+** one request of a server) whose objects are expected to die together.
+** Nested regions are folded into the outermost one, so only the
+** memory in use when the outermost region opens is recorded.
+*/
+void luaC_pushregion (lua_State *L) {
+  global_State *g = G(L);
+  if (g->nregions++ == 0)  /* opening outermost region? */
+    g->regionbase = getheapbytes(g);
+}
+
+
+/*
+** Close a region. When the outermost region closes, collect the
+** garbage it produced. Objects are never moved, so a region cannot be
+** released as a block; instead, in generational mode, all objects
+** created inside the region are young, so a minor collection frees
+** the dead ones and promotes the survivors without visiting the old
+** generation. (The step keeps the real debt, so it still does a major
+** collection when one is due.) In incremental mode, the allocations
+** of the region are already in the debt; if that debt is due, the
+** collector pays it now instead of in the middle of the next burst of
+** work. Returns true if the collector did some work.
+*/
+int luaC_popregion (lua_State *L) {
+  global_State *g = G(L);
+  l_mem allocated;
+  lua_assert(g->nregions > 0);
+  if (--g->nregions > 0 || !gcrunning(g))
+    return 0;  /* inner region or collector stopped */
+  allocated = cast(l_mem, getheapbytes(g) - g->regionbase);
+  if (allocated <= 0)  /* region created no net garbage? */
+    return 0;
+  if (g->gckind == KGC_GEN)  /* generational mode? */
+    genstep(L, g);
+  else if (g->GCdebt > 0)  /* incremental step is due? */
+    luaC_step(L);
+  else
+    return 0;
+  return 1;
+}
+
+/* }====================================================== */
+
+
+
+
+
+/*
+** {======================================================
+** Heap snapshot
+** =======================================================
+*/
+
+/* size of the buffer used to write a snapshot */
+#if !defined(LUAI_SNAPSHOTBUFF)
+#define LUAI_SNAPSHOTBUFF	1024
+#endif
+
+/* maximum number of characters of a string shown in a snapshot */
+#define SNAPSHOTSTRLEN		40
+
+
+/*
+** A snapshot is written as a sequence of lines, each one a JSON object:
+** first a line with the roots, then one line per live object with its
+** address, type, size (including the memory it owns, such as the parts
+** of a table or the stack of a thread), and the objects it refers to
+** ("refs"). A weak table lists apart the objects it refers to without
+** keeping them alive ("weak"); an ephemeron table also lists the pairs
+** key-value whose values are kept only by their keys ("ephemerons").
+** The writer is called with the state unlocked, as in 'lua_dump'.
+** Everything goes through a fixed buffer in the C stack, so taking a
+** snapshot does not allocate any memory.
+*/
+typedef struct SnapState {
+  lua_State *L;
+  lua_Writer writer;
+  void *data;
+  int status;
+  int nrefs;  /* number of references written for current object */
+  size_t n;  /* number of bytes in 'buff' */
+  char buff[LUAI_SNAPSHOTBUFF];
+} SnapState;
+
+
+static void snapflush (SnapState *S) {
+  if (S->status == 0 && S->n > 0) {
+    lua_unlock(S->L);
+    S->status = (*S->writer)(S->L, S->buff, S->n, S->data);
+    lua_lock(S->L);
+  }
+  S->n = 0;
+}
+
+
+static void snapchars (SnapState *S, const char *s, size_t len) {
+  while (len > 0) {
+    size_t l = sizeof(S->buff) - S->n;
+    if (l == 0) {
+      snapflush(S);
+      l = sizeof(S->buff);
+    }
+    if (l > len) l = len;
+    memcpy(S->buff + S->n, s, l);
+    S->n += l;
+    s += l;
+    len -= l;
+  }
+}
+
+#define snapliteral(S,s)	snapchars(S, "" s, (sizeof(s)/sizeof(char))-1)
+
+
+static void snapaddress (SnapState *S, const void *p) {
+  char buff[LUAI_MAXSHORTLEN];
+  int len = lua_pointer2str(buff, sizeof(buff), p);
+  snapliteral(S, "\"");
+  snapchars(S, buff, len);
+  snapliteral(S, "\"");
+}
+
+
+static void snapsize (SnapState *S, lu_mem n) {
+  char buff[LUAI_MAXSHORTLEN];
+  int len = l_sprintf(buff, sizeof(buff), "%lu", cast(unsigned long, n));
+  snapchars(S, buff, len);
+}
+
+
+/*
+** Write a prefix of a string for a JSON string, escaping quotes,
+** backslashes, control characters, and non-ASCII bytes.
+*/
+static void snapescaped (SnapState *S, const char *s, size_t len) {
+  size_t i;
+  for (i = 0; i < len && i < SNAPSHOTSTRLEN; i++) {
+    unsigned char c = cast(unsigned char, s[i]);
+    if (c == '"' || c == '\\') {
+      char esc[2];
+      esc[0] = '\\'; esc[1] = cast_char(c);
+      snapchars(S, esc, 2);
+    }
+    else if (c < 0x20 || c >= 0x7f) {
+      char buff[8];
+      int l = l_sprintf(buff, sizeof(buff), "\\u%04x", c);
+      snapchars(S, buff, l);
+    }
+    else
+      snapchars(S, cast_charp(&c), 1);
+  }
+}
+
+
+static void snapref (SnapState *S, GCObject *o) {
+  if (o != NULL) {
+    if (S->nrefs++ > 0)
+      snapliteral(S, ",");
+    snapaddress(S, o);
+  }
+}
+
+#define snapvalue(S,v)	snapref(S, gcvalueN(v))
+
+/* write a reference to an object that can be NULL */
+#define snapobjectN(S,t)	{ if (t) snapref(S, obj2gco(t)); }
+
+
+/*
+** Size of an object plus all the memory it owns.
+*/
+static lu_mem objsize (GCObject *o) {
+  switch (o->tt) {
+    case LUA_VTABLE: {
+      Table *h = gco2t(o);
+      return sizeof(Table) + luaH_realasize(h) * sizeof(TValue) +
+             allocsizenode(h) * sizeof(Node) +
+             ((h->cards != NULL) ? sizecards(h->cards->n) : 0);
+    }
+    case LUA_VLCL: return sizeLclosure(gco2lcl(o)->nupvalues);
+    case LUA_VCCL: return sizeCclosure(gco2ccl(o)->nupvalues);
+    case LUA_VUSERDATA: {
+      Udata *u = gco2u(o);
+      return sizeudata(u->nuvalue, u->len);
+    }
+    case LUA_VSHRSTR: return sizelstring(gco2ts(o)->shrlen);
+    case LUA_VLNGSTR: {
+      TString *ts = gco2ts(o);
+      if (!strisext(ts))
+        return sizelstring(ts->u.lnglen);
+      else if (ts->shrlen == LSTRMEM)  /* has its own copy of the contents */
+        return sizestrref + (ts->u.lnglen + 1) * sizeof(char);
+      else
+        return sizestrref;
+    }
+    case LUA_VUPVAL: return sizeof(UpVal);
+    case LUA_VPROTO: {
+      Proto *f = gco2p(o);
+      return sizeof(Proto) + f->sizecode * sizeof(Instruction) +
+             f->sizep * sizeof(Proto *) + f->sizek * sizeof(TValue) +
+             f->sizelineinfo * sizeof(ls_byte) +
+             f->sizeabslineinfo * sizeof(AbsLineInfo) +
+             f->sizelocvars * sizeof(LocVar) +
+             f->sizeupvalues * sizeof(Upvaldesc);
+    }
+    case LUA_VTHREAD: {
+      lua_State *th = gco2th(o);
+      lu_mem sz = LUA_EXTRASPACE + sizeof(lua_State) +
+                  th->nci * sizeof(CallInfo);
+      if (th->stack != NULL)
+        sz += (stacksize(th) + EXTRA_STACK) * sizeof(StackValue);
+      return sz;
+    }
+    default: lua_assert(0); return 0;
+  }
+}
+
+
+/* which parts of a table are weak */
+#define SNAPWEAKKEY	1
+#define SNAPWEAKVALUE	2
+
+/* kinds of references from a table */
+#define SNAPSTRONG	0
+#define SNAPWEAK	1
+#define SNAPEPHEMERON	2  /* value kept only by its key */
+
+/* kind of a reference from a weak part of a table */
+#define snapweakref(o)  \
+	(((o) != NULL && novariant((o)->tt) != LUA_TSTRING) ? SNAPWEAK : SNAPSTRONG)
+
+
+static int snapweakness (SnapState *S, Table *h) {
+  const TValue *mode = gfasttm(G(S->L), h->metatable, TM_MODE);
+  int w = 0;
+  if (mode && ttisstring(mode)) {
+    if (hasmode(tsvalue(mode), 'k')) w |= SNAPWEAKKEY;
+    if (hasmode(tsvalue(mode), 'v')) w |= SNAPWEAKVALUE;
+  }
+  return w;
+}
+
+
+/*
+** Write the references of kind 'kind' from a table with weakness 'w',
+** following 'iscleared': strings and non-collectable values are never
+** weak. An ephemeron reference is written as a pair key-value.
+*/
+static void snaptable (SnapState *S, Table *h, int w, int kind) {
+  unsigned int i;
+  unsigned int asize = luaH_realasize(h);
+  Node *n, *limit = gnodelast(h);
+  if (kind == SNAPSTRONG)
+    snapobjectN(S, h->metatable);
+  for (i = 0; i < asize; i++) {
+    GCObject *v = gcvalueN(&h->array[i]);
+    int vk = (w & SNAPWEAKVALUE) ? snapweakref(v) : SNAPSTRONG;
+    if (vk == kind)
+      snapref(S, v);
+  }
+  for (n = gnode(h, 0); n < limit; n++) {
+    if (!isempty(gval(n))) {
+      GCObject *k = gckeyN(n);
+      GCObject *v = gcvalueN(gval(n));
+      int kk = (w & SNAPWEAKKEY) ? snapweakref(k) : SNAPSTRONG;
+      int vk;
+      if (w & SNAPWEAKVALUE)
+        vk = snapweakref(v);
+      else if (kk == SNAPWEAK && v != NULL)
+        vk = SNAPEPHEMERON;
+      else
+        vk = SNAPSTRONG;
+      if (kind == SNAPEPHEMERON) {
+        if (vk == SNAPEPHEMERON) {
+          snapref(S, k);
+          snapref(S, v);
+        }
+      }
+      else {
+        if (kk == kind) snapref(S, k);
+        if (vk == kind) snapref(S, v);
+      }
+    }
+  }
+}
+
+
+/*
+** Write the references from an object, following the same paths
+** the collector uses to traverse it. (References that do not keep
+** their objects alive, from weak tables, go apart; see 'snapobject'.)
+*/
+static void snaprefs (SnapState *S, GCObject *o) {
+  int i;
+  switch (o->tt) {
+    case LUA_VTABLE: {
+      Table *h = gco2t(o);
+      snaptable(S, h, snapweakness(S, h), SNAPSTRONG);
+      break;
+    }
+    case LUA_VLCL: {
+      LClosure *cl = gco2lcl(o);
+      snapobjectN(S, cl->p);
+      for (i = 0; i < cl->nupvalues; i++)
+        snapobjectN(S, cl->upvals[i]);
+      break;
+    }
+    case LUA_VCCL: {
+      CClosure *cl = gco2ccl(o);
+      for (i = 0; i < cl->nupvalues; i++)
+        snapvalue(S, &cl->upvalue[i]);
+      break;
+    }
+    case LUA_VUSERDATA: {
+      Udata *u = gco2u(o);
+      snapobjectN(S, u->metatable);
+      for (i = 0; i < u->nuvalue; i++)
+        snapvalue(S, &u->uv[i].uv);
+      break;
+    }
+    case LUA_VUPVAL: {
+      snapvalue(S, gco2upv(o)->v);
+      break;
+    }
+    case LUA_VPROTO: {
+      Proto *f = gco2p(o);
+      snapobjectN(S, f->source);
+      for (i = 0; i < f->sizek; i++)
+        snapvalue(S, &f->k[i]);
+      for (i = 0; i < f->sizeupvalues; i++)
+        snapobjectN(S, f->upvalues[i].name);
+      for (i = 0; i < f->sizep; i++)
+        snapobjectN(S, f->p[i]);
+      for (i = 0; i < f->sizelocvars; i++)
+        snapobjectN(S, f->locvars[i].varname);
+      break;
+    }
+    case LUA_VTHREAD: {
+      lua_State *th = gco2th(o);
+      StkId s;
+      UpVal *uv;
+      if (th->stack == NULL)
+        break;  /* stack not completely built yet */
+      for (s = th->stack; s < th->top; s++)
+        snapvalue(S, s2v(s));
+      for (uv = th->openupval; uv != NULL; uv = uv->u.open.next)
+        snapref(S, obj2gco(uv));
+      break;
+    }
+    case LUA_VLNGSTR: {
+      TString *ts = gco2ts(o);
+      if (strparent(ts) != NULL)
+        snapref(S, obj2gco(strparent(ts)));
+      break;
+    }
+    default: break;  /* other strings have no references */
+  }
+}
+
+
+static void snapobject (SnapState *S, GCObject *o) {
+  const char *tname = ttypename(novariant(o->tt));
+  snapliteral(S, "{\"id\":");
+  snapaddress(S, o);
+  snapliteral(S, ",\"type\":\"");
+  snapchars(S, tname, strlen(tname));
+  snapliteral(S, "\",\"size\":");
+  snapsize(S, objsize(o));
+  snapliteral(S, ",\"refs\":[");
+  S->nrefs = 0;
+  snaprefs(S, o);
+  snapliteral(S, "]");
+  if (o->tt == LUA_VTABLE) {
+    int w = snapweakness(S, gco2t(o));
+    if (w != 0) {  /* weak table? */
+      snapliteral(S, ",\"weak\":[");
+      S->nrefs = 0;
+      snaptable(S, gco2t(o), w, SNAPWEAK);
+      snapliteral(S, "]");
+    }
+    if (w == SNAPWEAKKEY) {  /* ephemeron table? */
+      snapliteral(S, ",\"ephemerons\":[");
+      S->nrefs = 0;
+      snaptable(S, gco2t(o), w, SNAPEPHEMERON);
+      snapliteral(S, "]");
+    }
+  }
+  if (novariant(o->tt) == LUA_TSTRING) {
+    TString *ts = gco2ts(o);
+    snapliteral(S, ",\"name\":\"");
+    snapescaped(S, getstr(ts), tsslen(ts));
+    snapliteral(S, "\"");
+  }
+  else if (o->tt == LUA_VPROTO && gco2p(o)->source != NULL) {
+    Proto *f = gco2p(o);
+    char buff[LUAI_MAXSHORTLEN];
+    int len = l_sprintf(buff, sizeof(buff), ":%d", f->linedefined);
+    snapliteral(S, ",\"name\":\"");
+    snapescaped(S, getstr(f->source), tsslen(f->source));
+    snapchars(S, buff, len);
+    snapliteral(S, "\"");
+  }
+  snapliteral(S, "}\n");
+}
+
+
+static void snaplist (SnapState *S, GCObject *o) {
+  global_State *g = G(S->L);
+  for (; o != NULL && S->status == 0; o = o->next) {
+    if (!(issweepphase(g) && isdead(g, o)))  /* skip unswept garbage */
+      snapobject(S, o);
+  }
+}
+
+
+/*
+** Write a snapshot of all live objects. (During a sweep phase, objects
+** not yet swept can be dead, and dead objects can refer to objects
+** already freed; so, they are not visited.)
+*/
+int luaC_snapshot (lua_State *L, lua_Writer writer, void *data) {
+  global_State *g = G(L);
+  SnapState S;
+  int i;
+  S.L = L; S.writer = writer; S.data = data;
+  S.status = 0; S.n = 0; S.nrefs = 0;
+  snapliteral(&S, "{\"roots\":[");
+  snapvalue(&S, &g->l_registry);
+  snapref(&S, obj2gco(g->mainthread));
+  for (i = 0; i < LUA_NUMTAGS; i++)
+    snapobjectN(&S, g->mt[i]);
+  for (i = 0; i < 2; i++) {  /* objects being finalized and fixed objects */
+    GCObject *o;
+    for (o = (i == 0) ? g->tobefnz : g->fixedgc; o != NULL; o = o->next)
+      snapref(&S, o);
+  }
+  snapliteral(&S, "]}\n");
+  snaplist(&S, g->allgc);
+  snaplist(&S, g->finobj);
+  snaplist(&S, g->tobefnz);
+  snaplist(&S, g->fixedgc);
+  snapflush(&S);
+  return S.status;
+}
+
+/* }====================================================== */
@@ -71,15 +71,14 @@
 
 /*
 ** Layout for bit use in 'marked' field. First three bits are
-** used for object "age" in generational mode. Last bit is used
-** by tests.
+** used for object "age" in generational mode. Last bit marks
+** objects watched to decide on pretenuring.
 */
 #define WHITE0BIT	3  /* object is white (type 0) */
 #define WHITE1BIT	4  /* object is white (type 1) */
 #define BLACKBIT	5  /* object is black */
 #define FINALIZEDBIT	6  /* object has been marked for finalization */
-
-#define TESTBIT		7
+#define SAMPLEBIT	7  /* object is a sample of its allocation site */
 
 
 
@@ -123,6 +122,24 @@
 	check_exp(getage(o) == (f), (o)->marked ^= ((f)^(t)))
 
 
+/*
+** Cards of a big table: each card covers CARDSIZE consecutive slots
+** (array part first, then hash part) and tells whether they got new
+** values since the last minor collection (CARDNEW) or before it
+** (CARDOLD). See 'luaC_barriertable_' in file 'lgc.c'.
+*/
+#define CARDSIZE	128
+#define CARDNEW		1
+#define CARDOLD		2
+
+typedef struct Cards {
+  unsigned int n;  /* number of cards */
+  lu_byte card[1];
+} Cards;
+
+#define sizecards(n)	(offsetof(Cards, card) + (n) * sizeof(lu_byte))
+
+
 /* Default Values for GC parameters */
 #define LUAI_GENMAJORMUL         100
 #define LUAI_GENMINORMUL         20
@@ -174,6 +191,13 @@
 #define luaC_checkGC(L)		luaC_condGC(L,(void)0,(void)0)
 
 
+/*
+** Count 'n' more bytes (fewer, if 'n' is negative) for the objects of
+** kind 'k' (see 'lua_GCTypes'), when the parts they own change size.
+*/
+#define luaC_kindbytes(g,k,n)	((g)->gcobjbytes[k] += cast(lu_mem, (n)))
+
+
 #define luaC_barrier(L,p,v) (  \
 	(iscollectable(v) && isblack(p) && iswhite(gcvalue(v))) ?  \
 	luaC_barrier_(L,obj2gco(p),gcvalue(v)) : cast_void(0))
@@ -182,11 +206,28 @@
 	(iscollectable(v) && isblack(p) && iswhite(gcvalue(v))) ? \
 	luaC_barrierback_(L,p) : cast_void(0))
 
+/* barrier for a store of 'v' into 'slot' of table 't' */
+#define luaC_barriertable(L,t,slot,v) (  \
+	(iscollectable(v) && isblack(t) && iswhite(gcvalue(v))) ? \
+	luaC_barriertable_(L,t,slot) : cast_void(0))
+
+/* feedback from a site ('pc') that created table or closure 'o' */
+#define luaC_allocsite(L,o,pc)  \
+	{ if (G(L)->gckind == KGC_GEN) luaC_allocsite_(L,obj2gco(o),pc); }
+
+/*
+** barrier for a change in the stack of thread 'th': a quiet thread
+** may be left black by the collector (see 'traversethread')
+*/
+#define luaC_threadbarrier(L,th) (  \
+	isblack(th) ? luaC_barrierback_(L,obj2gco(th)) : cast_void(0))
+
 #define luaC_objbarrier(L,p,o) (  \
 	(isblack(p) && iswhite(o)) ? \
 	luaC_barrier_(L,obj2gco(p),obj2gco(o)) : cast_void(0))
 
 LUAI_FUNC void luaC_fix (lua_State *L, GCObject *o);
+LUAI_FUNC void luaC_ownblock (lua_State *L, int k, size_t sz);
 LUAI_FUNC void luaC_freeallobjects (lua_State *L);
 LUAI_FUNC void luaC_step (lua_State *L);
 LUAI_FUNC void luaC_runtilstate (lua_State *L, int statesmask);
@@ -194,8 +235,20 @@ LUAI_FUNC void luaC_fullgc (lua_State *L, int isemergency);
 LUAI_FUNC GCObject *luaC_newobj (lua_State *L, int tt, size_t sz);
 LUAI_FUNC void luaC_barrier_ (lua_State *L, GCObject *o, GCObject *v);
 LUAI_FUNC void luaC_barrierback_ (lua_State *L, GCObject *o);
+LUAI_FUNC void luaC_barriertable_ (lua_State *L, Table *t,
+                                   const TValue *slot);
+LUAI_FUNC void luaC_allocsite_ (lua_State *L, GCObject *o,
+                                const Instruction *pc);
+LUAI_FUNC void luaC_resizecards (lua_State *L, Table *t, Cards *old);
+LUAI_FUNC void luaC_freecards (lua_State *L, Table *t);
 LUAI_FUNC void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt);
 LUAI_FUNC void luaC_changemode (lua_State *L, int newmode);
+LUAI_FUNC void luaC_adaptive (lua_State *L, int on);
+LUAI_FUNC lu_mem luaC_runfinalizers (lua_State *L, lu_mem usec);
+LUAI_FUNC int luaC_stepfor (lua_State *L, lu_mem usec);
+LUAI_FUNC void luaC_pushregion (lua_State *L);
+LUAI_FUNC int luaC_popregion (lua_State *L);
+LUAI_FUNC int luaC_snapshot (lua_State *L, lua_Writer writer, void *data);
 
 
 #endif
@@ -205,7 +205,8 @@ typedef l_uint32 Instruction;
 
 
 /*
-** Initial size for the string table (must be power of 2).
+** Initial number of slots for the string table (must be power of 2;
+** the table has groups of 'STRTGROUP' slots, see 'lstring.c').
 ** The Lua core alone registers ~50 strings (reserved words +
 ** metaevent keys + a few others). Libraries would typically add
 ** a few dozens more.
@@ -215,6 +216,21 @@ typedef l_uint32 Instruction;
 #endif
 
 
+/*
+** Minimum length of a substring of a long string to be created as a
+** slice of that string, without copying its contents (see 'luaS_sub').
+** A slice keeps its whole parent alive, so it must also be at least
+** 1/2^LUAI_SLICEFRAC of the length of its parent.
+*/
+#if !defined(LUAI_MINSLICE)
+#define LUAI_MINSLICE	256
+#endif
+
+#if !defined(LUAI_SLICEFRAC)
+#define LUAI_SLICEFRAC	3
+#endif
+
+
 /*
 ** Size of cache for strings in the API. 'N' is the number of
 ** sets (better be a prime) and "M" is the size of each set (M == 1
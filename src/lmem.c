@@ -156,6 +156,58 @@ static void *tryagain (lua_State *L, void *block,
 }
 
 
+/*
+** Check the memory limits before allocating 'delta' more bytes.
+** Crossing the soft limit makes the collector start working right
+** away (see 'setpause' in 'lgc.c') and calls the limit function.
+** Crossing the hard limit runs an emergency collection and, if that
+** does not free enough memory, calls the limit function and refuses
+** the allocation. Returns true if the allocation can proceed.
+*/
+static int checklimits (lua_State *L, size_t delta) {
+  global_State *g = G(L);
+  if (g->memsoftlimit != 0 && !g->memsoftsignaled &&
+      gettotalbytes(g) + delta > g->memsoftlimit) {
+    g->memsoftsignaled = 1;  /* signal it only once per crossing */
+    luaE_setmemcheck(g);
+    if (g->GCdebt < 0)
+      luaE_setdebt(g, 0);  /* collector will start at the next check */
+    if (g->memlimitf)
+      (*g->memlimitf)(g->ud_memlimit, 0, gettotalbytes(g) + delta);
+  }
+  if (g->memhardlimit != 0 && gettotalbytes(g) + delta > g->memhardlimit) {
+    if (completestate(g) && !g->gcstopem)
+      luaC_fullgc(L, 1);  /* try to free some memory... */
+    if (gettotalbytes(g) + delta > g->memhardlimit) {  /* still too much? */
+      if (g->memlimitf)
+        (*g->memlimitf)(g->ud_memlimit, 1, gettotalbytes(g) + delta);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+
+/*
+** Test whether growing a block from 'os' to 'ns' bytes respects the
+** memory limits. (Only allocations that cross 'memcheck' pay for the
+** real check.)
+*/
+#define withinlimits(L,g,os,ns)  \
+	((ns) <= (os) || gettotalbytes(g) + ((ns) - (os)) <= (g)->memcheck ||  \
+	 checklimits(L, (ns) - (os)))
+
+
+/*
+** Count 'n' more allocated bytes for the allocation sampler. The
+** sample is taken before the allocation, while the stack still
+** describes the code that is allocating.
+*/
+#define countalloc(L,g,n)  \
+	{ if (l_unlikely(((g)->allocsample -= cast(l_mem, n)) <= 0))  \
+	    luaG_allocsample(L, n); }
+
+
 /*
 ** Generic allocation routine.
 */
@@ -163,6 +215,10 @@ void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
   void *newblock;
   global_State *g = G(L);
   lua_assert((osize == 0) == (block == NULL));
+  if (l_unlikely(!withinlimits(L, g, osize, nsize)))
+    return NULL;  /* do not update 'GCdebt' */
+  if (nsize > osize)
+    countalloc(L, g, nsize - osize);
   newblock = firsttry(g, block, osize, nsize);
   if (l_unlikely(newblock == NULL && nsize > 0)) {
     newblock = tryagain(L, block, osize, nsize);
@@ -189,7 +245,11 @@ void *luaM_malloc_ (lua_State *L, size_t size, int tag) {
     return NULL;  /* that's all */
   else {
     global_State *g = G(L);
-    void *newblock = firsttry(g, NULL, tag, size);
+    void *newblock;
+    if (l_unlikely(!withinlimits(L, g, 0, size)))
+      luaM_error(L);
+    countalloc(L, g, size);
+    newblock = firsttry(g, NULL, tag, size);
     if (l_unlikely(newblock == NULL)) {
       newblock = tryagain(L, NULL, tag, size);
       if (newblock == NULL)
@@ -11,6 +11,7 @@
 #include "lprefix.h"
 
 
+#include <float.h>
 #include <locale.h>
 #include <math.h>
 #include <stdarg.h>
@@ -23,6 +24,7 @@
 #include "lctype.h"
 #include "ldebug.h"
 #include "ldo.h"
+#include "lgc.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
@@ -221,6 +223,156 @@ static lua_Number lua_strx2number (const char *s, char **endptr) {
 #define L_MAXLENNUM	200
 #endif
 
+/*
+** {==================================================================
+** Fast conversion of decimal numerals (see LUA_NOFASTFMT)
+** ===================================================================
+*/
+
+#if !defined(LUA_NOFASTFMT) && LUA_FLOAT_TYPE == LUA_FLOAT_DOUBLE && \
+    defined(__SIZEOF_INT128__) && !defined(LUA_USE_C89)
+
+#define L_FASTDOUBLE
+
+typedef unsigned __int128 l_uint128;
+
+/* powers of 10 that fit in 64 bits */
+static const unsigned long long pow10tab[] = {
+  1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull,
+  10000000ull, 100000000ull, 1000000000ull, 10000000000ull,
+  100000000000ull, 1000000000000ull, 10000000000000ull,
+  100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+  100000000000000000ull, 1000000000000000000ull,
+  10000000000000000000ull
+};
+
+#define MAXPOW10	19
+
+
+/* number of significant bits in 'a' (which cannot be zero) */
+static int bitlen128 (l_uint128 a) {
+  unsigned long long hi = (unsigned long long)(a >> 64);
+  return (hi != 0) ? 128 - __builtin_clzll(hi)
+                   : 64 - __builtin_clzll((unsigned long long)a);
+}
+
+
+/*
+** Round 'a' * 2^'be' to the nearest double, with ties to even. 'sticky'
+** tells whether 'a' was truncated (so that a tie is not a real tie).
+*/
+static lua_Number round2double (l_uint128 a, int be, int sticky) {
+  int sh = bitlen128(a) - 53;  /* bits to be discarded */
+  unsigned long long mant;
+  if (sh <= 0)
+    mant = (unsigned long long)a;  /* exact */
+  else {
+    l_uint128 r = a & ((((l_uint128)1) << sh) - 1);  /* discarded bits */
+    l_uint128 half = ((l_uint128)1) << (sh - 1);
+    mant = (unsigned long long)(a >> sh);
+    if (r > half || (r == half && (sticky || (mant & 1))))
+      mant++;  /* round up (may give 2^53, which is still exact) */
+    be += sh;
+  }
+  return l_mathop(ldexp)(cast_num(mant), be);
+}
+
+
+/*
+** Compute 'm' * 10^'e10' correctly rounded, for 'm' > 0. Returns 0 if
+** the exponent is out of the range it can handle.
+*/
+static int decimal2d (unsigned long long m, int e10, lua_Number *result) {
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+  /* powers of 10 that are exact as doubles */
+  static const double dpow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  if (m <= (1ull << 53) && -22 <= e10 && e10 <= 22) {
+    /* both operands are exact, so a single IEEE operation rounds right */
+    lua_Number d = cast_num(m);
+    *result = (e10 < 0) ? d / dpow10[-e10] : d * dpow10[e10];
+    return 1;
+  }
+#endif
+  if (0 <= e10 && e10 <= MAXPOW10)  /* exact product in 128 bits */
+    *result = round2double((l_uint128)m * pow10tab[e10], 0, 0);
+  else if (-MAXPOW10 <= e10 && e10 < 0) {
+    /* scale 'm' up to use all 128 bits, so that the quotient keeps
+       at least 64 significant bits */
+    int sh = 64 + __builtin_clzll(m);
+    l_uint128 a = ((l_uint128)m) << sh;
+    unsigned long long p = pow10tab[-e10];
+    *result = round2double(a / p, -sh, (a % p) != 0);
+  }
+  else
+    return 0;
+  return 1;
+}
+
+
+/*
+** Convert a decimal numeral of the form
+** [spaces][sign]digits[.digits][(e|E)[sign]digits][spaces]
+** with at most 19 significant digits, without using the C library.
+** Returns NULL when it cannot handle the numeral; the caller then
+** uses 'lua_str2number', which decides whether the numeral is valid.
+*/
+static const char *l_str2dfast (const char *s, lua_Number *result) {
+  unsigned long long m = 0;  /* significant digits */
+  int nd = 0;  /* number of significant digits */
+  int e10 = 0;  /* decimal exponent */
+  int empty = 1;
+  int neg;
+  while (lisspace(cast_uchar(*s))) s++;  /* skip initial spaces */
+  neg = isneg(&s);
+  for (; lisdigit(cast_uchar(*s)); s++) {
+    empty = 0;
+    if (m == 0 && *s == '0') continue;  /* skip leading zeros */
+    if (nd++ == MAXPOW10) return NULL;  /* too many digits */
+    m = m * 10 + (*s - '0');
+  }
+  if (*s == '.') {
+    const char *f = ++s;  /* start of fraction */
+    for (; lisdigit(cast_uchar(*s)); s++) {
+      empty = 0;
+      if (m == 0 && *s == '0') continue;
+      if (nd++ == MAXPOW10) return NULL;
+      m = m * 10 + (*s - '0');
+    }
+    if (s - f > L_MAXLENNUM) return NULL;  /* fraction too long */
+    e10 = -cast_int(s - f);
+  }
+  if (empty) return NULL;
+  if (*s == 'e' || *s == 'E') {
+    int exp = 0;
+    int eneg;
+    s++;  /* skip 'e' */
+    eneg = isneg(&s);
+    if (!lisdigit(cast_uchar(*s))) return NULL;
+    for (; lisdigit(cast_uchar(*s)); s++) {
+      if (exp < 10000)  /* else it is out of range anyway */
+        exp = exp * 10 + (*s - '0');
+    }
+    e10 += (eneg) ? -exp : exp;
+  }
+  while (lisspace(cast_uchar(*s))) s++;  /* skip trailing spaces */
+  if (*s != '\0') return NULL;
+  if (m == 0)
+    *result = 0;
+  else if (!decimal2d(m, e10, result))
+    return NULL;
+  if (neg)
+    *result = -*result;
+  return s;
+}
+
+#endif
+
+/* }================================================================== */
+
+
 /*
 ** Convert string 's' to a Lua number (put in 'result'). Return NULL on
 ** fail or the address of the ending '\0' on success. ('mode' == 'x')
@@ -251,8 +403,14 @@ static const char *l_str2dloc (const char *s, lua_Number *result, int mode) {
 */
 static const char *l_str2d (const char *s, lua_Number *result) {
   const char *endptr;
-  const char *pmode = strpbrk(s, ".xXnN");  /* look for special chars */
-  int mode = pmode ? ltolower(cast_uchar(*pmode)) : 0;
+  const char *pmode;
+  int mode;
+#if defined(L_FASTDOUBLE)
+  if ((endptr = l_str2dfast(s, result)) != NULL)
+    return endptr;
+#endif
+  pmode = strpbrk(s, ".xXnN");  /* look for special chars */
+  mode = pmode ? ltolower(cast_uchar(*pmode)) : 0;
   if (mode == 'n')  /* reject 'inf' and 'nan' */
     return NULL;
   endptr = l_str2dloc(s, result, mode);  /* try to convert */
@@ -350,6 +508,178 @@ int luaO_utf8esc (char *buff, unsigned long x) {
 #define MAXNUMBER2STR	44
 
 
+/*
+** {==================================================================
+** Fast conversions of numbers to strings (see LUA_NOFASTFMT)
+** ===================================================================
+*/
+
+#if !defined(LUA_NOFASTFMT)
+
+static const char digitpairs[] =
+  "00010203040506070809" "10111213141516171819" "20212223242526272829"
+  "30313233343536373839" "40414243444546474849" "50515253545556575859"
+  "60616263646566676869" "70717273747576777879" "80818283848586878889"
+  "90919293949596979899";
+
+
+/*
+** Write the decimal digits of 'u' backwards, ending just before 'e';
+** return the position of the first digit.
+*/
+static char *writedigits (char *e, lua_Unsigned u) {
+  while (u >= 100) {  /* two digits at a time */
+    const char *d = digitpairs + (u % 100) * 2;
+    u /= 100;
+    *--e = d[1];
+    *--e = d[0];
+  }
+  if (u >= 10) {
+    const char *d = digitpairs + u * 2;
+    *--e = d[1];
+    *--e = d[0];
+  }
+  else
+    *--e = cast_char('0' + u);
+  return e;
+}
+
+
+/* same as 'lua_integer2str' with LUA_INTEGER_FMT */
+static int fmtint (char *buff, lua_Integer i) {
+  char temp[MAXNUMBER2STR];
+  char *e = temp + sizeof(temp);
+  lua_Unsigned u = l_castS2U(i);
+  char *p;
+  int len;
+  if (i < 0)
+    u = 0u - u;  /* absolute value (correct even for LUA_MININTEGER) */
+  p = writedigits(e, u);
+  if (i < 0)
+    *--p = '-';
+  len = cast_int(e - p);
+  memcpy(buff, p, len);
+  buff[len] = '\0';
+  return len;
+}
+
+
+#if defined(L_FASTDOUBLE) && defined(LUAI_NUMDIGITS) && LUAI_NUMDIGITS <= 15
+
+#define NDIG	LUAI_NUMDIGITS
+
+
+/*
+** Round 'm' * 2^'be' * 10^'k' to an integer, with ties to even (as
+** the C library does). 'm' has 53 bits and 'be' is in [-127, -1], so
+** the product is exact in 128 bits.
+*/
+static unsigned long long scaledround (unsigned long long m, int be,
+                                       int k) {
+  l_uint128 a = (l_uint128)m * pow10tab[k];
+  int s = -be;
+  unsigned long long n = (unsigned long long)(a >> s);
+  l_uint128 r = a & ((((l_uint128)1) << s) - 1);  /* discarded bits */
+  l_uint128 half = ((l_uint128)1) << (s - 1);
+  if (r > half || (r == half && (n & 1)))
+    n++;
+  return n;
+}
+
+
+/*
+** Same as 'lua_number2str' with format "%.<NDIG>g", for the numbers
+** that format writes without an exponent. The result is the integer
+** 'n' with NDIG digits, computed exactly, such that 'x' rounded to
+** NDIG significant digits is 'n' * 10^(X - NDIG + 1). Returns 0 if it
+** cannot handle 'x'.
+*/
+static int fmtflt (char *buff, lua_Number x) {
+  char digits[NDIG];
+  lua_Number ax = l_mathop(fabs)(x);
+  unsigned long long m, n;
+  int be, X, nd, i;
+  int len = 0;
+  if (ax == 0) {  /* "0" or "-0" */
+    if (signbit(x))
+      buff[len++] = '-';
+    buff[len++] = '0';
+    buff[len] = '\0';
+    return len;
+  }
+  else if (!(ax >= 1e-5 && ax < 1e15))  /* exponent form, inf, or NaN? */
+    return 0;  /* let the C library handle it */
+  /* ax == m * 2^be, with 'm' an integer with 53 bits */
+  m = (unsigned long long)(l_mathop(frexp)(ax, &be) * 9007199254740992.0);
+  be -= 53;
+  /* estimate decimal exponent (may be one less than the correct one) */
+  X = cast_int(l_floor((be + 52) * 0.30102999566398120));
+  for (;;) {
+    int k = NDIG - 1 - X;
+    if (k < 0 || k >= cast_int(sizeof(pow10tab) / sizeof(pow10tab[0])))
+      return 0;
+    n = scaledround(m, be, k);
+    if (n < pow10tab[NDIG - 1])  /* too few digits? */
+      X--;
+    else if (n >= pow10tab[NDIG])  /* too many digits (or a carry)? */
+      X++;
+    else
+      break;
+  }
+  if (!(-4 <= X && X < NDIG))  /* "%g" would use an exponent? */
+    return 0;
+  for (i = NDIG - 1; i >= 0; i--) {  /* get the digits */
+    digits[i] = cast_char('0' + n % 10);
+    n /= 10;
+  }
+  for (nd = NDIG; digits[nd - 1] == '0'; nd--) { }  /* strip zeros */
+  if (x < 0)
+    buff[len++] = '-';
+  if (X >= 0) {
+    for (i = 0; i <= X; i++)  /* integer part */
+      buff[len++] = digits[i];
+    if (nd > X + 1) {  /* has a fraction? */
+      buff[len++] = lua_getlocaledecpoint();
+      for (; i < nd; i++)
+        buff[len++] = digits[i];
+    }
+  }
+  else {
+    buff[len++] = '0';
+    buff[len++] = lua_getlocaledecpoint();
+    for (i = X + 1; i < 0; i++)  /* leading zeros */
+      buff[len++] = '0';
+    for (i = 0; i < nd; i++)
+      buff[len++] = digits[i];
+  }
+  buff[len] = '\0';
+  return len;
+}
+
+#else
+
+#define fmtflt(buff,x)	0
+
+#endif
+
+
+static int flttostr (char *buff, lua_Number x) {
+  int len = fmtflt(buff, x);
+  if (len == 0)  /* not handled? */
+    len = lua_number2str(buff, MAXNUMBER2STR, x);
+  return len;
+}
+
+#else
+
+#define fmtint(buff,i)		lua_integer2str(buff, MAXNUMBER2STR, i)
+#define flttostr(buff,x)	lua_number2str(buff, MAXNUMBER2STR, x)
+
+#endif
+
+/* }================================================================== */
+
+
 /*
 ** Convert a number object to a string, adding it to a buffer
 */
@@ -357,9 +687,9 @@ static int tostringbuff (TValue *obj, char *buff) {
   int len;
   lua_assert(ttisnumber(obj));
   if (ttisinteger(obj))
-    len = lua_integer2str(buff, MAXNUMBER2STR, ivalue(obj));
+    len = fmtint(buff, ivalue(obj));
   else {
-    len = lua_number2str(buff, MAXNUMBER2STR, fltvalue(obj));
+    len = flttostr(buff, fltvalue(obj));
     if (buff[strspn(buff, "-0123456789")] == '\0') {  /* looks like an int? */
       buff[len++] = lua_getlocaledecpoint();
       buff[len++] = '0';  /* adds '.0' to result */
@@ -473,6 +803,7 @@ const char *luaO_pushvfstring (lua_State *L, const char *fmt, va_list argp) {
   const char *e;  /* points to next '%' */
   buff.pushed = buff.blen = 0;
   buff.L = L;
+  luaC_threadbarrier(L, L);  /* result goes to the stack */
   while ((e = strchr(fmt, '%')) != NULL) {
     addstr2buff(&buff, fmt, e - fmt);  /* add 'fmt' up to '%' */
     switch (*(e + 1)) {  /* conversion specifier */
@@ -421,22 +421,70 @@ typedef struct GCObject {
 typedef struct TString {
   CommonHeader;
   lu_byte extra;  /* reserved words for short strings; "has hash" for longs 短字符串的保留字 */
-  lu_byte shrlen;  /* length for short strings 短字符串的长度 */
+  lu_byte shrlen;  /* length for short strings; kind for longs 短字符串的长度 */
   unsigned int hash;
   union {
     size_t lnglen;  /* length for long strings 长字符串的长度 */
-    struct TString *hnext;  /* linked list for hash table 哈希表的链表列表 */
   } u;
   char contents[1];
 } TString;
 
 
+/*
+** Kinds of long strings. A regular string keeps its contents after its
+** header. The other kinds have a 'StrRef' there instead, pointing to
+** their contents: an external string points to a buffer owned by the
+** host, freed with its own function; a slice points into the contents
+** of a parent string; a slice is "materialized" (when someone needs
+** its contents with a final '\0') by giving it its own copy of them.
+** A materialized slice still keeps its parent alive, as C code may
+** hold pointers into the old contents. An external string whose
+** buffer came from Lua's own allocator is adopted as a materialized
+** one without a parent.
+** The values for these kinds are larger than any short-string length.
+** 长字符串的种类：普通字符串、外部字符串（内容由宿主拥有）、切片（指向父
+** 字符串的内容）和已物化的切片。
+*/
+#define LSTRREG		0	/* regular long string */
+#define LSTREXT		0xFD	/* external string */
+#define LSTRMEM		0xFE	/* contents in a buffer owned by Lua */
+#define LSTRSLICE	0xFF	/* slice */
+
+typedef struct StrRef {
+  char *s;  /* contents */
+  union {
+    struct TString *parent;  /* string owning the old contents (or NULL) */
+    struct {  /* external strings */
+      lua_Alloc falloc;  /* function to free 's' (may be NULL) */
+      void *ud;  /* user data for 'falloc' */
+    } ext;
+  } u;
+} StrRef;
+
+#define tsref(ts)	check_exp((ts)->shrlen >= LSTREXT, \
+			          cast(StrRef *, (ts)->contents))
+
+/* test whether string 'ts' does not keep its own contents after it */
+#define strisext(ts)	((ts)->shrlen >= LSTREXT)
+
+/* test whether string 'ts' is a slice (without a final '\0') */
+#define strisslice(ts)	((ts)->shrlen == LSTRSLICE)
+
+/* parent of a slice or of a materialized slice (NULL if none) */
+#define strparent(ts)  \
+	((ts)->shrlen >= LSTRMEM ? tsref(ts)->u.parent : NULL)
+
 
 /*
-** Get the actual string (array of bytes) from a 'TString'.
-** 从'TString'中获取实际字符串（字节数组）
+** Get the actual string (array of bytes) from a 'TString'. Slices are
+** not zero-terminated.
+** 从'TString'中获取实际字符串（字节数组）。切片不以零结尾。
 */
-#define getstr(ts)  ((ts)->contents)
+#define getstr(ts)  \
+	(l_likely(!strisext(ts)) ? (ts)->contents : tsref(ts)->s)
+
+/* get the actual string of a short string 获取短字符串的实际字符串 */
+#define getshrstr(ts)	check_exp((ts)->tt == LUA_VSHRSTR, (ts)->contents)
 
 
 /* 
@@ -607,6 +655,7 @@ typedef struct Proto {
   lu_byte numparams;  /* number of fixed (named) parameters 固定（命名）参数的数量 */
   lu_byte is_vararg;
   lu_byte maxstacksize;  /* number of registers needed by this function 此函数所需的寄存器数量 */
+  lu_byte counted;  /* true if its parts count in 'gcobjbytes' */
   int sizeupvalues;  /* size of 'upvalues' 上值的大小 */
   int sizek;  /* size of 'k' */
   int sizecode;
@@ -798,6 +847,7 @@ typedef struct Table {
   Node *lastfree;  /* any free position is before this position */
   struct Table *metatable;
   GCObject *gclist;
+  struct Cards *cards;  /* dirty regions, for big tables (see 'lgc.c') */
 } Table;
 
 
@@ -97,6 +97,20 @@ void luaE_setdebt (global_State *g, l_mem debt) {
 }
 
 
+/*
+** Set the memory use above which allocations must check the memory
+** limits: the lower between the soft limit (while not yet crossed) and
+** the hard limit.
+*/
+void luaE_setmemcheck (global_State *g) {
+  lu_mem check = (g->memhardlimit != 0) ? g->memhardlimit : MAX_LUMEM;
+  if (g->memsoftlimit != 0 && !g->memsoftsignaled &&
+      g->memsoftlimit < check)
+    check = g->memsoftlimit;
+  g->memcheck = check;
+}
+
+
 LUA_API int lua_setcstacklimit (lua_State *L, unsigned int limit) {
   UNUSED(L); UNUSED(limit);
   return LUAI_MAXCCALLS;  /* warning?? */
@@ -107,6 +121,7 @@ CallInfo *luaE_extendCI (lua_State *L) {
   CallInfo *ci;
   lua_assert(L->ci->next == NULL);
   ci = luaM_new(L, CallInfo);
+  luaC_kindbytes(G(L), LUA_GCKTHREAD, sizeof(CallInfo));
   lua_assert(L->ci->next == NULL);
   L->ci->next = ci;
   ci->previous = L->ci;
@@ -127,6 +142,7 @@ void luaE_freeCI (lua_State *L) {
   while ((ci = next) != NULL) {
     next = ci->next;
     luaM_free(L, ci);
+    luaC_kindbytes(G(L), LUA_GCKTHREAD, -cast(l_mem, sizeof(CallInfo)));
     L->nci--;
   }
 }
@@ -146,6 +162,7 @@ void luaE_shrinkCI (lua_State *L) {
     ci->next = next2;  /* remove next from the list */
     L->nci--;
     luaM_free(L, next);  /* free next */
+    luaC_kindbytes(G(L), LUA_GCKTHREAD, -cast(l_mem, sizeof(CallInfo)));
     if (next2 == NULL)
       break;  /* no more elements */
     else {
@@ -182,6 +199,8 @@ static void stack_init (lua_State *L1, lua_State *L) {
   int i; CallInfo *ci;
   /* initialize stack array */
   L1->stack = luaM_newvector(L, BASIC_STACK_SIZE + EXTRA_STACK, StackValue);
+  luaC_kindbytes(G(L), LUA_GCKTHREAD,
+                 (BASIC_STACK_SIZE + EXTRA_STACK) * sizeof(StackValue));
   L1->tbclist = L1->stack;
   for (i = 0; i < BASIC_STACK_SIZE + EXTRA_STACK; i++)
     setnilvalue(s2v(L1->stack + i));  /* erase new stack */
@@ -202,12 +221,15 @@ static void stack_init (lua_State *L1, lua_State *L) {
 
 
 static void freestack (lua_State *L) {
+  size_t n;
   if (L->stack == NULL)
     return;  /* stack not completely built yet */
   L->ci = &L->base_ci;  /* free the entire 'ci' list */
   luaE_freeCI(L);
   lua_assert(L->nci == 0);
-  luaM_freearray(L, L->stack, stacksize(L) + EXTRA_STACK);  /* free stack */
+  n = cast_sizet(stacksize(L) + EXTRA_STACK);
+  luaM_freearray(L, L->stack, n);  /* free stack */
+  luaC_kindbytes(G(L), LUA_GCKTHREAD, -cast(l_mem, n * sizeof(StackValue)));
 }
 
 
@@ -277,8 +299,9 @@ static void close_state (lua_State *L) {
     luaC_freeallobjects(L);  /* collect all objects */
     luai_userstateclose(L);
   }
-  luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size);
+  luaS_freetable(L);
   freestack(L);
+  luaG_freeallocprofile(g);
   lua_assert(gettotalbytes(g) == sizeof(LG));
   (*g->frealloc)(g->ud, fromstate(L), sizeof(LG), 0);  /* free main block */
 }
@@ -297,6 +320,8 @@ LUA_API lua_State *lua_newthread (lua_State *L) {
   /* link it on list 'allgc' */
   L1->next = g->allgc;
   g->allgc = obj2gco(L1);
+  g->gcobjs[LUA_GCKTHREAD]++;
+  luaC_kindbytes(g, LUA_GCKTHREAD, sizeof(LX));
   /* anchor it on L stack */
   setthvalue2s(L, L->top, L1);
   api_incr_top(L);
@@ -322,11 +347,14 @@ void luaE_freethread (lua_State *L, lua_State *L1) {
   luai_userstatefree(L, L1);
   freestack(L1);
   luaM_free(L, l);
+  luaC_kindbytes(G(L), LUA_GCKTHREAD, -cast(l_mem, sizeof(LX)));
 }
 
 
 int luaE_resetthread (lua_State *L, int status) {
-  CallInfo *ci = L->ci = &L->base_ci;  /* unwind CallInfo list */
+  CallInfo *ci;
+  luaC_threadbarrier(L, L);  /* its stack will change */
+  ci = L->ci = &L->base_ci;  /* unwind CallInfo list */
   setnilvalue(s2v(L->stack));  /* 'function' entry for basic 'ci' */
   ci->func = L->stack;
   ci->callstatus = CIST_C;
@@ -372,11 +400,22 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->ud = ud;
   g->warnf = NULL;
   g->ud_warn = NULL;
+  g->memlimitf = NULL;
+  g->ud_memlimit = NULL;
+  g->memsoftlimit = g->memhardlimit = 0;
+  g->memsoftsignaled = 0;
+  g->memcheck = MAX_LUMEM;
+  g->allocsample = MAX_LMEM;
+  g->samplerate = 0;
+  g->allocprof = NULL;
+  g->ephemap = NULL;
   g->mainthread = L;
   g->seed = luai_makeseed(L);
   g->gcstp = GCSTPGC;  /* no GC while building state */
   g->strt.size = g->strt.nuse = 0;
-  g->strt.hash = NULL;
+  g->strt.hash = g->strt.old = NULL;
+  g->strt.block = g->strt.oldblock = NULL;
+  g->strt.oldsize = g->strt.moved = 0;
   setnilvalue(&g->l_registry);
   g->panic = NULL;
   g->gcstate = GCSpause;
@@ -392,7 +431,29 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->twups = NULL;
   g->totalbytes = sizeof(LG);
   g->GCdebt = 0;
+  g->lobytes = g->lolimit = 0;
   g->lastatomic = 0;
+  g->gccycles = g->gcminors = g->gcswitches = 0;
+  g->gclastswitch = NULL;
+  g->gcfinbudget = g->gcfindeadline = 0;
+  g->gcfinpending = g->gcfinalized = 0;
+  for (i = 0; i < LUA_NUMGCKINDS; i++)
+    g->gcobjs[i] = g->gcobjbytes[i] = 0;
+  g->gcobjs[LUA_GCKTHREAD] = 1;  /* the main thread */
+  g->gcobjbytes[LUA_GCKTHREAD] = sizeof(LX);
+  g->gcpretenured = 0;
+  memset(g->gcsites, 0, sizeof(g->gcsites));
+  memset(g->gcsamples, 0, sizeof(g->gcsamples));
+  g->gcnsamples = 0;
+  g->gcadaptive = g->gcvotes = g->gcconfirms = g->gcadaptneed = 0;
+  g->gcadaptbase = 0;
+  g->nregions = 0;
+  g->regionbase = 0;
+#if defined(LUA_BYTECMP)
+  g->strcmpmode = LUA_STRCMPBYTES;
+#else
+  g->strcmpmode = LUA_STRCMPLOCALE;
+#endif
   setivalue(&g->nilvalue, 0);  /* to signal that state is not yet built */
   setgcparam(g->gcpause, LUAI_GCPAUSE);
   setgcparam(g->gcstepmul, LUAI_GCMUL);
@@ -423,19 +484,42 @@ void luaE_warning (lua_State *L, const char *msg, int tocont) {
 }
 
 
+/*
+** Send a slice (up to its first '\0') to the warning function, in
+** pieces with a final '\0'. (Materializing it could raise an error.)
+*/
+static void warnslice (lua_State *L, TString *ts) {
+  char buff[LUAI_MAXSHORTLEN + 1];
+  const char *s = getstr(ts);
+  size_t l = tsslen(ts);
+  const char *z = cast(const char *, memchr(s, '\0', l));
+  if (z != NULL)
+    l = cast_sizet(z - s);
+  while (l > 0) {
+    size_t n = (l < LUAI_MAXSHORTLEN) ? l : LUAI_MAXSHORTLEN;
+    memcpy(buff, s, n * sizeof(char));
+    buff[n] = '\0';
+    luaE_warning(L, buff, 1);
+    s += n; l -= n;
+  }
+}
+
+
 /*
 ** Generate a warning from an error message
 */
 void luaE_warnerror (lua_State *L, const char *where) {
   TValue *errobj = s2v(L->top - 1);  /* error object */
-  const char *msg = (ttisstring(errobj))
-                  ? svalue(errobj)
-                  : "error object is not a string";
   /* produce warning "error in %s (%s)" (where, msg) */
   luaE_warning(L, "error in ", 1);
   luaE_warning(L, where, 1);
   luaE_warning(L, " (", 1);
-  luaE_warning(L, msg, 1);
+  if (!ttisstring(errobj))
+    luaE_warning(L, "error object is not a string", 1);
+  else if (strisslice(tsvalue(errobj)))
+    warnslice(L, tsvalue(errobj));
+  else
+    luaE_warning(L, svalue(errobj), 1);
   luaE_warning(L, ")", 0);
 }
 
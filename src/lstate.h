@@ -148,13 +148,54 @@ struct lua_longjmp;  /* defined in ldo.c */
 #define KGC_GEN		1	/* generational gc */
 
 
+/*
+** The table of short strings uses open addressing. Its slots come in
+** groups the size of a cache line, each slot with a fragment of the
+** hash of its string, so that a probe seldom touches strings that do
+** not match (see 'lstring.c').
+*/
+#define STRTGROUP	7  /* slots per group */
+
+typedef struct StrGroup {
+  lu_byte tag[STRTGROUP];  /* hash fragments (0 for empty slots) */
+  lu_byte over;  /* number of strings that probed past this group */
+  TString *s[STRTGROUP];
+} StrGroup;
+
 typedef struct stringtable {
-  TString **hash;
-  int nuse;  /* number of elements */
-  int size;
+  StrGroup *hash;  /* (aligned to a cache line) */
+  void *block;  /* memory block holding 'hash' */
+  int nuse;  /* number of elements (in both arrays) */
+  int size;  /* number of groups */
+  StrGroup *old;  /* previous array, while it is moved into 'hash' */
+  void *oldblock;  /* memory block holding 'old' */
+  int oldsize;  /* number of groups in 'old' */
+  int moved;  /* number of groups of 'old' already moved */
 } stringtable;
 
 
+/*
+** Survival feedback for the sites that create tables and closures,
+** used to pretenure objects in generational mode (see 'lgc.c')
+*/
+#define NALLOCSITES	64
+#define NSITESAMPLES	32
+
+typedef struct AllocSite {
+  const Instruction *pc;  /* instruction of this site (NULL if none) */
+  lu_byte pending;  /* objects from this site still being watched */
+  lu_byte samples;  /* watched objects whose fate is known */
+  lu_byte survivors;  /* how many of those became old */
+  lu_byte old;  /* true if this site creates objects already old */
+  lu_byte count;  /* objects created old since last one watched */
+} AllocSite;
+
+typedef struct SiteSample {
+  GCObject *o;  /* watched object (NULL if slot is free) */
+  const Instruction *pc;  /* its site */
+} SiteSample;
+
+
 /*
 ** Information about a call.
 ** About union 'u':
@@ -253,7 +294,29 @@ typedef struct global_State {
   l_mem totalbytes;  /* number of bytes currently allocated - GCdebt */
   l_mem GCdebt;  /* bytes allocated not yet compensated by the collector */
   lu_mem GCestimate;  /* an estimate of the non-garbage memory in use */
+  lu_mem lobytes;  /* bytes in the large-object space (see 'lgc.c') */
+  lu_mem lolimit;  /* size of that space above which it adds to the debt */
   lu_mem lastatomic;  /* see function 'genstep' in file 'lgc.c' */
+  lu_mem regionbase;  /* heap bytes when outermost region was opened */
+  lu_mem memsoftlimit;  /* soft limit for memory in use (0 if none) */
+  lu_mem memhardlimit;  /* hard limit for memory in use (0 if none) */
+  lu_mem memcheck;  /* memory use above which limits must be checked */
+  l_mem allocsample;  /* bytes to be allocated before next sample */
+  lu_mem samplerate;  /* average bytes between samples (0 if off) */
+  lu_mem gcadaptbase;  /* memory in use after last collection (adaptive) */
+  lu_mem gccycles;  /* number of complete (non-minor) collections */
+  lu_mem gcminors;  /* number of minor collections */
+  lu_mem gcswitches;  /* number of automatic switches of mode */
+  const char *gclastswitch;  /* reason for last automatic switch */
+  lu_mem gcfinbudget;  /* time budget for finalizers in a step (usec) */
+  lu_mem gcfindeadline;  /* end of budget for current step (0 if none) */
+  lu_mem gcfinpending;  /* number of objects in 'tobefnz' */
+  lu_mem gcfinalized;  /* number of objects already finalized */
+  lu_mem gcobjs[LUA_NUMGCKINDS];  /* number of objects of each kind */
+  lu_mem gcobjbytes[LUA_NUMGCKINDS];  /* bytes used by each kind */
+  lu_mem gcpretenured;  /* number of objects created old */
+  AllocSite gcsites[NALLOCSITES];  /* allocation sites being watched */
+  SiteSample gcsamples[NSITESAMPLES];  /* objects being watched */
   stringtable strt;  /* hash table for strings */
   TValue l_registry;
   TValue nilvalue;  /* a nil value */
@@ -269,6 +332,14 @@ typedef struct global_State {
   lu_byte gcpause;  /* size of pause between successive GCs */
   lu_byte gcstepmul;  /* GC "speed" */
   lu_byte gcstepsize;  /* (log2 of) GC granularity */
+  lu_byte memsoftsignaled;  /* true if soft limit crossed since last GC */
+  lu_byte gcadaptive;  /* true if collector chooses its mode by itself */
+  lu_byte gcnsamples;  /* number of objects in 'gcsamples' */
+  lu_byte gcvotes;  /* consecutive collections voting for a switch */
+  lu_byte gcconfirms;  /* consecutive collections voting for current mode */
+  lu_byte gcadaptneed;  /* number of votes needed for a switch */
+  lu_byte strcmpmode;  /* how to order strings (see 'l_strcmp') */
+  int nregions;  /* number of open allocation regions */
   GCObject *allgc;  /* list of all collectable objects */
   GCObject **sweepgc;  /* current position of sweep in list */
   GCObject *finobj;  /* list of collectable objects with finalizers */
@@ -296,6 +367,10 @@ typedef struct global_State {
   TString *strcache[STRCACHE_N][STRCACHE_M];  /* cache for strings in API */
   lua_WarnFunction warnf;  /* warning function */
   void *ud_warn;         /* auxiliary data to 'warnf' */
+  lua_MemLimitFunction memlimitf;  /* called when crossing memory limits */
+  void *ud_memlimit;     /* auxiliary data to 'memlimitf' */
+  struct AllocProfile *allocprof;  /* samples of allocations */
+  struct EphMap *ephemap;  /* pending ephemeron entries (see 'lgc.c') */
 } global_State;
 
 
@@ -389,7 +464,11 @@ union GCUnion {
 /* actual number of total bytes allocated */
 #define gettotalbytes(g)	cast(lu_mem, (g)->totalbytes + (g)->GCdebt)
 
+/* bytes allocated outside the large-object space, which pace the collector */
+#define getheapbytes(g)		(gettotalbytes(g) - (g)->lobytes)
+
 LUAI_FUNC void luaE_setdebt (global_State *g, l_mem debt);
+LUAI_FUNC void luaE_setmemcheck (global_State *g);
 LUAI_FUNC void luaE_freethread (lua_State *L, lua_State *L1);
 LUAI_FUNC CallInfo *luaE_extendCI (lua_State *L);
 LUAI_FUNC void luaE_freeCI (lua_State *L);
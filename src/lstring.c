@@ -11,10 +11,12 @@
 #include "lprefix.h"
 
 
+#include <limits.h>
 #include <string.h>
 
 #include "lua.h"
 
+#include "lctype.h"
 #include "ldebug.h"
 #include "ldo.h"
 #include "lmem.h"
@@ -26,7 +28,7 @@
 /*
 ** Maximum size for string table. 字符串表的最大大小
 */
-#define MAXSTRTB	cast_int(luaM_limitN(MAX_INT, TString*))
+#define MAXSTRTB	cast_int(luaM_limitN(MAX_INT / STRTGROUP, StrGroup))
 
 
 /*
@@ -41,6 +43,115 @@ int luaS_eqlngstr (TString *a, TString *b) {
 }
 
 
+/*
+** {======================================================
+** String hashing
+** 字符串哈希
+** =======================================================
+*/
+
+#if !defined(LUA_USE_C89) && defined(ULLONG_MAX)
+
+/*
+** With 64-bit integers, strings are hashed a word at a time, in the
+** style of 'wyhash': each step multiplies two 64-bit words mixed with
+** the seed and folds the 128-bit product. All bytes of the string
+** take part in the hash and the seed perturbs every step, so it keeps
+** the resistance against collision attacks given by 'luai_makeseed'.
+** 有 64 位整数时，字符串按字哈希（'wyhash' 风格）：每步将两个与种子混合的
+** 64 位字相乘并折叠 128 位乘积。种子参与每一步，保持对碰撞攻击的抵抗力。
+*/
+typedef unsigned long long l_hword;
+
+#define HK0	0xa0761d6478bd642fULL
+#define HK1	0xe7037ed1a0b428dbULL
+#define HK2	0x8ebc6af09c88c6e3ULL
+
+/* read (unaligned) words in native byte order 读取（未对齐的）字 */
+static l_hword read8 (const unsigned char *p) {
+  l_hword w;
+  memcpy(&w, p, sizeof(w));
+  return w;
+}
+
+static l_hword read4 (const unsigned char *p) {
+  l_uint32 w;
+  memcpy(&w, p, sizeof(w));
+  return w;
+}
+
+
+/* multiply 'a' and 'b' into a 128-bit result, low half in 'a' */
+static void mum (l_hword *a, l_hword *b) {
+#if defined(__SIZEOF_INT128__)
+  unsigned __int128 r = (unsigned __int128)*a * *b;
+  *a = (l_hword)r;
+  *b = (l_hword)(r >> 64);
+#else
+  l_hword ha = *a >> 32, hb = *b >> 32;
+  l_hword la = (l_uint32)*a, lb = (l_uint32)*b;
+  l_hword rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  l_hword t = rl + (rm0 << 32);
+  l_hword lo = t + (rm1 << 32);
+  l_hword hi = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+  *a = lo;
+  *b = hi;
+#endif
+}
+
+
+/* multiply and fold 乘法并折叠 */
+static l_hword mix (l_hword a, l_hword b) {
+  mum(&a, &b);
+  return a ^ b;
+}
+
+
+unsigned int luaS_hash (const char *str, size_t l, unsigned int seed) {
+  const unsigned char *p = cast(const unsigned char *, str);
+  l_hword s = mix(cast(l_hword, seed) ^ HK0, HK1);
+  l_hword a, b;
+  if (l <= 16) {  /* short string? 短字符串？ */
+    if (l >= 4) {  /* read (possibly overlapping) 4-byte words */
+      size_t d = (l >> 3) << 2;
+      a = (read4(p) << 32) | read4(p + d);
+      b = (read4(p + l - 4) << 32) | read4(p + l - 4 - d);
+    }
+    else if (l > 0) {
+      a = (cast(l_hword, p[0]) << 16) | (cast(l_hword, p[l >> 1]) << 8) |
+           p[l - 1];
+      b = 0;
+    }
+    else
+      a = b = 0;
+  }
+  else {
+    size_t i = l;
+    if (i > 48) {  /* long string: three independent lanes 三条独立通道 */
+      l_hword s1 = s, s2 = s;
+      do {
+        s = mix(read8(p) ^ HK1, read8(p + 8) ^ s);
+        s1 = mix(read8(p + 16) ^ HK2, read8(p + 24) ^ s1);
+        s2 = mix(read8(p + 32) ^ HK0, read8(p + 40) ^ s2);
+        p += 48; i -= 48;
+      } while (i > 48);
+      s ^= s1 ^ s2;
+    }
+    while (i > 16) {
+      s = mix(read8(p) ^ HK1, read8(p + 8) ^ s);
+      p += 16; i -= 16;
+    }
+    a = read8(p + i - 16);  /* last 16 bytes (may overlap) 最后 16 字节 */
+    b = read8(p + i - 8);
+  }
+  a ^= HK1;
+  b ^= s;
+  mum(&a, &b);
+  return cast_uint(mix(a ^ HK0 ^ cast(l_hword, l), b ^ HK1));
+}
+
+#else
+
 unsigned int luaS_hash (const char *str, size_t l, unsigned int seed) {
   unsigned int h = seed ^ cast_uint(l);
   for (; l > 0; l--)
@@ -48,6 +159,10 @@ unsigned int luaS_hash (const char *str, size_t l, unsigned int seed) {
   return h;
 }
 
+#endif
+
+/* }====================================================== */
+
 
 unsigned int luaS_hashlongstr (TString *ts) {
   lua_assert(ts->tt == LUA_VLNGSTR);
@@ -60,50 +175,284 @@ unsigned int luaS_hashlongstr (TString *ts) {
 }
 
 
-static void tablerehash (TString **vect, int osize, int nsize) {
+/*
+** {======================================================
+** String table
+** 字符串表
+** =======================================================
+*/
+
+/*
+** The string table is an array of groups of slots, with linear probing
+** over groups. Each slot keeps, besides the string, a byte with the
+** highest bits of its hash ('strtag'; zero means an empty slot), so
+** that a search compares strings only when their tags match. Each
+** group counts (up to MAXOVER) the strings that did not fit in it and
+** went on to a later group; a search for a missing string stops at the
+** first group without such strings. (A saturated counter is never
+** decremented, so it only makes some searches longer.) Removals
+** decrement the counters along the probe sequence, so that there is
+** no need for tombstones.
+** When the table grows, the old array is kept and moved to the new
+** one a few groups at a time, on each search ('movegroups'), so that
+** no single insertion pays for the whole rehash.
+** 字符串表是槽组的数组，组间线性探测。每个槽保存其哈希的高位字节，使查找只在
+** 标签匹配时比较字符串。增长时旧数组保留，并在每次查找时逐组迁移到新数组。
+*/
+
+/* minimum number of groups 最少组数 */
+#define MINSTRTGROUPS	(MINSTRTABSIZE / 8 > 0 ? MINSTRTABSIZE / 8 : 1)
+
+/* maximum load before growing (7/8 of the slots) 增长前的最大负载 */
+#define strtlimit(tb)	(strtslots(tb) - strtslots(tb) / 8)
+
+/* number of groups moved from the old array in each search */
+#define STRTMOVE	2
+
+#define MAXOVER		255
+
+#define strtag(h)	cast_byte(0x80 | ((h) >> 25))
+
+#define nextgroup(i,size)	(((i) + 1) & ((size) - 1))
+
+
+/* assumed size of a cache line 假定的缓存行大小 */
+#define STRTLINE	64
+
+/* size of a block for 'n' groups plus alignment 'n' 个组加对齐所需的块大小 */
+#define groupsblock(n)	(cast_sizet(n) * sizeof(StrGroup) + STRTLINE)
+
+
+/*
+** Allocate a cleared array of 'n' groups, aligned to a cache line (so
+** that a group spans as few lines as possible); return NULL if the
+** allocation fails.
+** 分配一个已清空的 'n' 个组的数组，按缓存行对齐；分配失败时返回 NULL。
+*/
+static StrGroup *newgroups (lua_State *L, int n, void **block) {
+  size_t p;
+  *block = luaM_realloc_(L, NULL, 0, groupsblock(n));
+  if (l_unlikely(*block == NULL))
+    return NULL;
+  p = (cast(size_t, *block) + (STRTLINE - 1)) & ~cast(size_t, STRTLINE - 1);
+  memset(cast_voidp(p), 0, cast_sizet(n) * sizeof(StrGroup));
+  return cast(StrGroup *, p);
+}
+
+
+static void freegroups (lua_State *L, void *block, int n) {
+  if (block != NULL)
+    luaM_freemem(L, block, groupsblock(n));
+}
+
+
+/*
+** 'matchtags' returns a mask of the slots of a group whose tags are
+** equal to 'tag' (empty slots, for tag 0); 'firstslot' gives the
+** lowest slot in a non-empty mask. On little-endian machines with
+** 64-bit integers, it compares all tags at once, as a word, without
+** branches that depend on the position of the match.
+** 'matchtags' 返回组中标签等于 'tag' 的槽的掩码；在有 64 位整数的小端机器上，
+** 它将所有标签作为一个字一次比较，没有依赖匹配位置的分支。
+*/
+#if !defined(LUA_USE_C89) && defined(ULLONG_MAX) && defined(__GNUC__) && \
+    defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && \
+    STRTGROUP == 7
+
+typedef unsigned long long TagMask;
+
+#define BYTES(b)	(0x0101010101010101ULL * (b))
+
+static TagMask matchtags (const StrGroup *gr, lu_byte tag) {
+  TagMask x;
+  memcpy(&x, gr->tag, sizeof(x));  /* all tags (plus 'over') */
+  x ^= BYTES(tag);  /* matching bytes become zero */
+  /* set the high bit of each zero byte (exactly, with no carries) */
+  x = ~(((x & BYTES(0x7f)) + BYTES(0x7f)) | x) & BYTES(0x80);
+  return x & ~(0xffULL << 56);  /* ignore 'over' */
+}
+
+#define firstslot(m)	(__builtin_ctzll(m) >> 3)
+
+#else
+
+typedef unsigned int TagMask;
+
+static TagMask matchtags (const StrGroup *gr, lu_byte tag) {
+  TagMask m = 0;
+  int j;
+  for (j = 0; j < STRTGROUP; j++) {
+    if (gr->tag[j] == tag)
+      m |= 1u << j;
+  }
+  return m;
+}
+
+static int firstslot (TagMask m) {
+  int j = 0;
+  while (!(m & 1u)) { m >>= 1; j++; }
+  return j;
+}
+
+#endif
+
+
+/*
+** Search for a short string in array 'vect'.
+** 在数组 'vect' 中查找短字符串
+*/
+static TString *findin (StrGroup *vect, int size, const char *str,
+                        size_t l, unsigned int h) {
+  lu_byte tag = strtag(h);
+  int i = lmod(h, size);
+  int n;
+  for (n = 0; n < size; n++) {
+    StrGroup *gr = &vect[i];
+    TagMask m;
+    for (m = matchtags(gr, tag); m != 0; m &= m - 1) {
+      TString *ts = gr->s[firstslot(m)];
+      if (l == ts->shrlen && memcmp(str, getshrstr(ts), l * sizeof(char)) == 0)
+        return ts;
+    }
+    if (gr->over == 0)  /* no string went past this group? */
+      break;
+    i = nextgroup(i, size);
+  }
+  return NULL;  /* not found */
+}
+
+
+/*
+** Insert string 'ts' into array 'vect', which must have a free slot.
+** 将字符串 'ts' 插入数组 'vect' （必须有空槽）
+*/
+static void insertin (StrGroup *vect, int size, TString *ts) {
+  int i = lmod(ts->hash, size);
+  for (;;) {
+    StrGroup *gr = &vect[i];
+    TagMask m = matchtags(gr, 0);  /* free slots */
+    if (m != 0) {
+      int j = firstslot(m);
+      gr->tag[j] = strtag(ts->hash);
+      gr->s[j] = ts;
+      return;
+    }
+    if (gr->over < MAXOVER)
+      gr->over++;  /* one more string past this group */
+    i = nextgroup(i, size);
+  }
+}
+
+
+/*
+** Correct the counters of the groups that the string with hash 'h'
+** went past, from its home group up to group 'pos', where it was.
+*/
+static void unprobe (StrGroup *vect, int size, unsigned int h, int pos) {
   int i;
-  for (i = osize; i < nsize; i++)  /* clear new elements 清除新元素 */
-    vect[i] = NULL;
-  for (i = 0; i < osize; i++) {  /* rehash old part of the array 重新刷新旧部分数组 */
-    TString *p = vect[i];
-    vect[i] = NULL;
-    while (p) {  /* for each string in the list 对于列表中的每个字符串 */
-      TString *hnext = p->u.hnext;  /* save next 保存下一个 */
-      unsigned int h = lmod(p->hash, nsize);  /* new position 新指针 */
-      p->u.hnext = vect[h];  /* chain it into array 将其链接到数组中 */
-      vect[h] = p;
-      p = hnext;
+  for (i = lmod(h, size); i != pos; i = nextgroup(i, size)) {
+    lua_assert(vect[i].over > 0);
+    if (vect[i].over < MAXOVER)
+      vect[i].over--;
+  }
+}
+
+
+/*
+** Remove string 'ts' from array 'vect'; return false if it is not there.
+** 从数组 'vect' 中删除字符串 'ts'；如果不在那里则返回 false
+*/
+static int removein (StrGroup *vect, int size, TString *ts) {
+  int i = lmod(ts->hash, size);
+  int n;
+  for (n = 0; n < size; n++) {
+    StrGroup *gr = &vect[i];
+    int j;
+    for (j = 0; j < STRTGROUP; j++) {
+      if (gr->s[j] == ts) {
+        gr->tag[j] = 0;
+        gr->s[j] = NULL;
+        unprobe(vect, size, ts->hash, i);
+        return 1;
+      }
+    }
+    if (gr->over == 0)
+      break;
+    i = nextgroup(i, size);
+  }
+  return 0;
+}
+
+
+/*
+** Move up to 'n' groups from the old array into the current one; free
+** the old array when it is empty.
+** 从旧数组向当前数组迁移最多 'n' 个组；旧数组为空时释放它
+*/
+static void movegroups (lua_State *L, stringtable *tb, int n) {
+  while (n-- > 0 && tb->old != NULL) {
+    StrGroup *gr = &tb->old[tb->moved];
+    int j;
+    for (j = 0; j < STRTGROUP; j++) {
+      if (gr->tag[j] != 0) {
+        TString *ts = gr->s[j];
+        unprobe(tb->old, tb->oldsize, ts->hash, tb->moved);
+        gr->tag[j] = 0;
+        gr->s[j] = NULL;
+        insertin(tb->hash, tb->size, ts);
+      }
+    }
+    if (++tb->moved == tb->oldsize) {  /* moved everything? */
+      freegroups(L, tb->oldblock, tb->oldsize);
+      tb->old = NULL;
+      tb->oldblock = NULL;
+      tb->oldsize = tb->moved = 0;
     }
   }
 }
 
 
 /*
-** Resize the string table. If allocation fails, keep the current size.
-** (This can degrade performance, but any non-zero size should work
-** correctly.)
-** 调整字符串表的大小。如果分配失败，请保持当前大小。（这会降低性能，但任何非零大小都应该正常工作。）
+** Resize the string table to 'nsize' groups. If allocation fails, keep
+** the current size. (This can degrade performance, but any table with
+** a free slot works correctly.) A grown table is filled incrementally;
+** a shrunk one (which happens only during collections) at once.
+** 调整字符串表的大小。如果分配失败，保持当前大小。增长的表逐步填充；
+** 缩小的表（仅在垃圾回收期间发生）一次性填充。
 */
 void luaS_resize (lua_State *L, int nsize) {
   stringtable *tb = &G(L)->strt;
-  int osize = tb->size;
-  TString **newvect;
-  if (nsize < osize)  /* shrinking table? 缩小表？*/
-    tablerehash(tb->hash, osize, nsize);  /* depopulate shrinking part 减少收缩部分 */
-  newvect = luaM_reallocvector(L, tb->hash, osize, nsize, TString*);
-  if (l_unlikely(newvect == NULL)) {  /* reallocation failed? 重新分配失败？ */
-    if (nsize < osize)  /* was it shrinking table? 是在缩小表吗？ */
-      tablerehash(tb->hash, nsize, osize);  /* restore to original size 恢复到原始大小 */
-    /* leave table as it was 让表保持原样 */
-  }
-  else {  /* allocation succeeded 分配成功 */
-    tb->hash = newvect;
-    tb->size = nsize;
-    if (nsize > osize)
-      tablerehash(newvect, osize, nsize);  /* rehash for new size 重新调整新尺寸 */
-  }
+  StrGroup *newvect;
+  void *block;
+  if (nsize < MINSTRTGROUPS)
+    nsize = MINSTRTGROUPS;
+  if (tb->old != NULL)  /* still moving from a previous resize? */
+    movegroups(L, tb, tb->oldsize);  /* finish it */
+  if (nsize == tb->size || tb->nuse >= nsize * STRTGROUP)
+    return;  /* nothing to be done (or new size too small) */
+  newvect = newgroups(L, nsize, &block);
+  if (l_unlikely(newvect == NULL))  /* allocation failed? 分配失败？ */
+    return;  /* leave table as it was 让表保持原样 */
+  tb->old = tb->hash;
+  tb->oldblock = tb->block;
+  tb->oldsize = tb->size;
+  tb->moved = 0;
+  tb->hash = newvect;
+  tb->block = block;
+  tb->size = nsize;
+  if (nsize < tb->oldsize)  /* shrinking? */
+    movegroups(L, tb, tb->oldsize);  /* move everything now */
+}
+
+
+void luaS_freetable (lua_State *L) {
+  stringtable *tb = &G(L)->strt;
+  freegroups(L, tb->block, tb->size);
+  freegroups(L, tb->oldblock, tb->oldsize);
 }
 
+/* }====================================================== */
+
 
 /*
 ** Clear API string cache. (Entries cannot be empty, so fill them with
@@ -128,9 +477,10 @@ void luaS_init (lua_State *L) {
   global_State *g = G(L);
   int i, j;
   stringtable *tb = &G(L)->strt;
-  tb->hash = luaM_newvector(L, MINSTRTABSIZE, TString*);
-  tablerehash(tb->hash, 0, MINSTRTABSIZE);  /* clear array 清除数组 */
-  tb->size = MINSTRTABSIZE;
+  tb->hash = newgroups(L, MINSTRTGROUPS, &tb->block);
+  if (tb->hash == NULL)
+    luaM_error(L);
+  tb->size = MINSTRTGROUPS;
   /* pre-create memory-error message 预创建内存错误消息 */
   g->memerrmsg = luaS_newliteral(L, MEMERRMSG);
   luaC_fix(L, obj2gco(g->memerrmsg));  /* it should never be collected 它永远不应该被收集 */
@@ -153,13 +503,14 @@ static TString *createstrobj (lua_State *L, size_t l, int tag, unsigned int h) {
   ts = gco2ts(o);
   ts->hash = h;
   ts->extra = 0;
-  getstr(ts)[l] = '\0';  /* ending 0 */
+  ts->contents[l] = '\0';  /* ending 0 */
   return ts;
 }
 
 
 TString *luaS_createlngstrobj (lua_State *L, size_t l) {
   TString *ts = createstrobj(L, l, LUA_VLNGSTR, G(L)->seed);
+  ts->shrlen = LSTRREG;
   ts->u.lnglen = l;
   return ts;
 }
@@ -167,10 +518,10 @@ TString *luaS_createlngstrobj (lua_State *L, size_t l) {
 
 void luaS_remove (lua_State *L, TString *ts) {
   stringtable *tb = &G(L)->strt;
-  TString **p = &tb->hash[lmod(ts->hash, tb->size)];
-  while (*p != ts)  /* find previous element 查找上一个元素 */
-    p = &(*p)->u.hnext;
-  *p = (*p)->u.hnext;  /* remove element from its list 从其列表中删除元素 */
+  if (!(tb->old != NULL && removein(tb->old, tb->oldsize, ts))) {
+    int found = removein(tb->hash, tb->size, ts);
+    lua_assert(found); UNUSED(found);
+  }
   tb->nuse--;
 }
 
@@ -183,6 +534,8 @@ static void growstrtab (lua_State *L, stringtable *tb) {
   }
   if (tb->size <= MAXSTRTB / 2)  /* can grow string table? 可以增长字符串表吗？ */
     luaS_resize(L, tb->size * 2);
+  if (tb->nuse >= strtslots(tb) - 1)  /* still no room? */
+    luaM_error(L);
 }
 
 
@@ -195,26 +548,27 @@ static TString *internshrstr (lua_State *L, const char *str, size_t l) {
   global_State *g = G(L);
   stringtable *tb = &g->strt;
   unsigned int h = luaS_hash(str, l, g->seed);
-  TString **list = &tb->hash[lmod(h, tb->size)];
   lua_assert(str != NULL);  /* otherwise 'memcmp'/'memcpy' are undefined 否则未定义 'memcmp'/'memcpy' */
-  for (ts = *list; ts != NULL; ts = ts->u.hnext) {
-    if (l == ts->shrlen && (memcmp(str, getstr(ts), l * sizeof(char)) == 0)) {
-      /* found! 找到 */
-      if (isdead(g, ts))  /* dead (but not collected yet)? 死亡（但尚未收集）？*/
-        changewhite(ts);  /* resurrect it 复活它 */
-      return ts;
-    }
+  if (l_unlikely(tb->old != NULL)) {  /* resizing? */
+    movegroups(L, tb, STRTMOVE);  /* move a few more groups */
+    ts = findin(tb->old, tb->oldsize, str, l, h);  /* not moved yet? */
+    if (ts == NULL)
+      ts = findin(tb->hash, tb->size, str, l, h);
+  }
+  else
+    ts = findin(tb->hash, tb->size, str, l, h);
+  if (ts != NULL) {  /* found! 找到 */
+    if (isdead(g, ts))  /* dead (but not collected yet)? 死亡（但尚未收集）？*/
+      changewhite(ts);  /* resurrect it 复活它 */
+    return ts;
   }
   /* else must create a new string 否则必须创建新字符串 */
-  if (tb->nuse >= tb->size) {  /* need to grow string table? 需要郑家字符串表吗？ */
+  if (tb->nuse >= strtlimit(tb))  /* need to grow string table? 需要增长字符串表吗？ */
     growstrtab(L, tb);
-    list = &tb->hash[lmod(h, tb->size)];  /* rehash with new size 用新尺寸重新冲洗 */
-  }
   ts = createstrobj(L, l, LUA_VSHRSTR, h);
-  memcpy(getstr(ts), str, l * sizeof(char));
+  memcpy(getshrstr(ts), str, l * sizeof(char));
   ts->shrlen = cast_byte(l);
-  ts->u.hnext = *list;
-  *list = ts;
+  insertin(tb->hash, tb->size, ts);
   tb->nuse++;
   return ts;
 }
@@ -238,6 +592,130 @@ TString *luaS_newlstr (lua_State *L, const char *str, size_t l) {
 }
 
 
+/*
+** Check whether 's' has a byte that cannot appear in a numeral, so
+** that it can never be converted to a number. (Conversions need a
+** final '\0', so they cannot handle slices; see 'l_strton' in lvm.c.)
+*/
+static int nonumeral (const char *s, size_t l) {
+  size_t i;
+  for (i = 0; i < l; i++) {
+    int c = cast_uchar(s[i]);
+    if (c == '\0' || (c < 0x80 && !lisxdigit(c) && !lisspace(c) &&
+                      strchr("xXpP.,+-", c) == NULL))
+      return 1;
+  }
+  return 0;
+}
+
+
+/*
+** Create a string with the 'l' bytes of string 'ts' starting at 'i'.
+** Long substrings of long strings become slices, which share the
+** contents of their parents. A slice of a slice refers to the parent
+** of the latter.
+** 创建一个字符串，其内容为字符串'ts'从'i'开始的'l'个字节。长字符串的长子串
+** 成为切片，与其父字符串共享内容。
+*/
+TString *luaS_sub (lua_State *L, TString *ts, size_t i, size_t l) {
+  const char *s = getstr(ts) + i;
+  TString *p = strisslice(ts) ? tsref(ts)->u.parent : ts;
+  lua_assert(i + l <= tsslen(ts));
+  if (l < LUAI_MINSLICE || ts->tt != LUA_VLNGSTR ||
+      l < (p->u.lnglen >> LUAI_SLICEFRAC) || !nonumeral(s, l))
+    return luaS_newlstr(L, s, l);
+  else {
+    GCObject *o = luaC_newobj(L, LUA_VLNGSTR, sizestrref);
+    TString *sl = gco2ts(o);
+    sl->extra = 0;
+    sl->shrlen = LSTRSLICE;
+    sl->hash = G(L)->seed;
+    sl->u.lnglen = l;
+    tsref(sl)->s = cast_charp(s);
+    tsref(sl)->u.parent = p;
+    return sl;
+  }
+}
+
+
+/*
+** Create an external string, whose contents (with a final '\0') live
+** in a buffer owned by the host, which 'falloc' frees when Lua does not
+** need it anymore. Short strings are still internalized, so their
+** buffers are freed at once, as are the buffers of failed creations.
+** A buffer from Lua's own allocator is adopted: it counts as memory
+** used by Lua, like the contents of any other string.
+** 创建外部字符串，其内容（以'\0'结尾）存放在宿主拥有的缓冲区中。
+*/
+struct NewExt {
+  const char *s;
+  size_t l;
+  lua_Alloc falloc;
+  void *ud;
+  TString *ts;  /* result */
+};
+
+
+static void f_newext (lua_State *L, void *ud) {
+  struct NewExt *ne = cast(struct NewExt *, ud);
+  if (ne->l <= LUAI_MAXSHORTLEN)  /* short string? */
+    ne->ts = internshrstr(L, ne->s, ne->l);  /* copy it */
+  else {
+    GCObject *o = luaC_newobj(L, LUA_VLNGSTR, sizestrref);
+    TString *ts = gco2ts(o);
+    ts->extra = 0;
+    ts->shrlen = LSTREXT;
+    ts->hash = G(L)->seed;
+    ts->u.lnglen = ne->l;
+    tsref(ts)->s = cast_charp(ne->s);
+    tsref(ts)->u.ext.falloc = ne->falloc;
+    tsref(ts)->u.ext.ud = ne->ud;
+    if (ne->falloc == G(L)->frealloc && ne->ud == G(L)->ud) {
+      /* buffer came from Lua's own allocator: adopt it */
+      size_t sz = (ne->l + 1) * sizeof(char);
+      tsref(ts)->u.parent = NULL;
+      ts->shrlen = LSTRMEM;
+      G(L)->GCdebt += cast(l_mem, sz);  /* now Lua owns those bytes */
+      luaC_ownblock(L, LUA_GCKLNGSTR, sz);
+    }
+    ne->ts = ts;
+  }
+}
+
+
+TString *luaS_newextlstr (lua_State *L, const char *s, size_t l,
+                                        lua_Alloc falloc, void *ud) {
+  struct NewExt ne;
+  int status;
+  ne.s = s; ne.l = l; ne.falloc = falloc; ne.ud = ud;
+  status = luaD_rawrunprotected(L, f_newext, &ne);
+  if (falloc != NULL && (status != LUA_OK || ne.ts->tt == LUA_VSHRSTR))
+    (*falloc)(ud, cast_voidp(s), l + 1, 0);  /* Lua does not need it */
+  if (l_unlikely(status != LUA_OK))
+    luaD_throw(L, status);  /* propagate the error */
+  return ne.ts;
+}
+
+
+/*
+** Give slice 'ts' its own copy of its contents, with a final '\0'. It
+** keeps its parent, because the caller (or another C function up in
+** the stack) may still be reading the old contents, which live there.
+** 为切片'ts'提供其内容的副本（以'\0'结尾）；它仍保留父字符串。
+*/
+const char *luaS_materialize (lua_State *L, TString *ts) {
+  size_t l = ts->u.lnglen;
+  char *buff = luaM_newvector(L, l + 1, char);
+  lua_assert(strisslice(ts));
+  memcpy(buff, tsref(ts)->s, l * sizeof(char));
+  buff[l] = '\0';
+  tsref(ts)->s = buff;  /* keep 'u.parent' */
+  ts->shrlen = LSTRMEM;
+  luaC_ownblock(L, LUA_GCKLNGSTR, (l + 1) * sizeof(char));
+  return buff;
+}
+
+
 /*
 ** Create or reuse a zero-terminated string, first checking in the
 ** cache (using the string address as a key). The cache can contain
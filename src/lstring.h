@@ -28,6 +28,9 @@
 */
 #define sizelstring(l)  (offsetof(TString, contents) + ((l) + 1) * sizeof(char))
 
+/* size of a string with a 'StrRef' (without any contents) */
+#define sizestrref	(offsetof(TString, contents) + sizeof(StrRef))
+
 #define luaS_newliteral(L, s)	(luaS_newlstr(L, "" s, \
                                  (sizeof(s)/sizeof(char))-1))
 
@@ -46,10 +49,27 @@
 #define eqshrstr(a,b)	check_exp((a)->tt == LUA_VSHRSTR, (a) == (b))
 
 
+/*
+** number of slots in the string table
+** 字符串表中的槽数
+*/
+#define strtslots(tb)	((tb)->size * STRTGROUP)
+
+
+/*
+** Get the contents of string 'ts' with a final '\0', materializing it
+** if it is a slice (which can raise a memory error).
+** 获取以'\0'结尾的字符串内容，如果是切片则将其物化（可能引发内存错误）
+*/
+#define luaS_cstr(L,ts)  \
+	(l_unlikely(strisslice(ts)) ? luaS_materialize(L, ts) : getstr(ts))
+
+
 LUAI_FUNC unsigned int luaS_hash (const char *str, size_t l, unsigned int seed);
 LUAI_FUNC unsigned int luaS_hashlongstr (TString *ts);
 LUAI_FUNC int luaS_eqlngstr (TString *a, TString *b);
 LUAI_FUNC void luaS_resize (lua_State *L, int newsize);
+LUAI_FUNC void luaS_freetable (lua_State *L);
 LUAI_FUNC void luaS_clearcache (global_State *g);
 LUAI_FUNC void luaS_init (lua_State *L);
 LUAI_FUNC void luaS_remove (lua_State *L, TString *ts);
@@ -57,6 +77,10 @@ LUAI_FUNC Udata *luaS_newudata (lua_State *L, size_t s, int nuvalue);
 LUAI_FUNC TString *luaS_newlstr (lua_State *L, const char *str, size_t l);
 LUAI_FUNC TString *luaS_new (lua_State *L, const char *str);
 LUAI_FUNC TString *luaS_createlngstrobj (lua_State *L, size_t l);
+LUAI_FUNC TString *luaS_sub (lua_State *L, TString *ts, size_t i, size_t l);
+LUAI_FUNC const char *luaS_materialize (lua_State *L, TString *ts);
+LUAI_FUNC TString *luaS_newextlstr (lua_State *L, const char *s, size_t l,
+                                   lua_Alloc falloc, void *ud);
 
 
 #endif
@@ -536,6 +536,11 @@ static void exchangehashpart (Table *t1, Table *t2) {
 }
 
 
+/* size of the array and hash parts of table 't' */
+#define partsize(t)	cast(l_mem, luaH_realasize(t) * sizeof(TValue) + \
+                                    allocsizenode(t) * sizeof(Node))
+
+
 /*
 ** Resize table 't' for the new given sizes. Both allocations (for
 ** the hash part and for the array part) can fail, which creates some
@@ -554,9 +559,12 @@ void luaH_resize (lua_State *L, Table *t, unsigned int newasize,
   unsigned int i;
   Table newt;  /* to keep the new hash part */
   unsigned int oldasize = setlimittosize(t);
+  l_mem oldparts = partsize(t);
   TValue *newarray;
+  Cards *cards = t->cards;
   /* create new hash part with appropriate size into 'newt' */
   setnodevector(L, &newt, nhsize);
+  t->cards = NULL;  /* entries will move; no card tracking meanwhile */
   if (newasize < oldasize) {  /* will array shrink? */
     t->alimit = newasize;  /* pretend array has new size... */
     exchangehashpart(t, &newt);  /* and new hash */
@@ -572,6 +580,7 @@ void luaH_resize (lua_State *L, Table *t, unsigned int newasize,
   newarray = luaM_reallocvector(L, t->array, oldasize, newasize, TValue);
   if (l_unlikely(newarray == NULL && newasize > 0)) {  /* allocation failed? */
     freehash(L, &newt);  /* release new hash part */
+    t->cards = cards;  /* entries did not move */
     luaM_error(L);  /* raise error (with array unchanged) */
   }
   /* allocation ok; initialize new part of the array */
@@ -583,6 +592,8 @@ void luaH_resize (lua_State *L, Table *t, unsigned int newasize,
   /* re-insert elements from old hash part into new parts */
   reinsert(L, &newt, t);  /* 'newt' now has the old hash */
   freehash(L, &newt);  /* free old hash part */
+  luaC_kindbytes(G(L), LUA_GCKTABLE, partsize(t) - oldparts);
+  luaC_resizecards(L, t, cards);
 }
 
 
@@ -629,12 +640,15 @@ Table *luaH_new (lua_State *L) {
   t->flags = cast_byte(maskflags);  /* table has no metamethod fields */
   t->array = NULL;
   t->alimit = 0;
+  t->cards = NULL;
   setnodevector(L, t, 0);
   return t;
 }
 
 
 void luaH_free (lua_State *L, Table *t) {
+  luaC_kindbytes(G(L), LUA_GCKTABLE, -partsize(t));
+  luaC_freecards(L, t);
   freehash(L, t);
   luaM_freearray(L, t->array, luaH_realasize(t));
   luaM_free(L, t);
@@ -712,9 +726,10 @@ void luaH_newkey (lua_State *L, Table *t, const TValue *key, TValue *value) {
     }
   }
   setnodekey(L, mp, key);
-  luaC_barrierback(L, obj2gco(t), key);
+  luaC_barriertable(L, t, gval(mp), key);
   lua_assert(isempty(gval(mp)));
   setobj2t(L, gval(mp), value);
+  luaC_barriertable(L, t, gval(mp), value);
 }
 
 
@@ -811,14 +826,17 @@ void luaH_finishset (lua_State *L, Table *t, const TValue *key,
                                    const TValue *slot, TValue *value) {
   if (isabstkey(slot))
     luaH_newkey(L, t, key, value);
-  else
+  else {
     setobj2t(L, cast(TValue *, slot), value);
+    luaC_barriertable(L, t, slot, value);
+  }
 }
 
 
 /*
-** beware: when using this function you probably need to check a GC
-** barrier and invalidate the TM cache.
+** beware: when using this function you probably need to invalidate
+** the TM cache. (The functions that set values in tables do their own
+** GC barriers, as only they know the slot of each value.)
 */
 void luaH_set (lua_State *L, Table *t, const TValue *key, TValue *value) {
   const TValue *slot = luaH_get(t, key);
@@ -833,8 +851,10 @@ void luaH_setint (lua_State *L, Table *t, lua_Integer key, TValue *value) {
     setivalue(&k, key);
     luaH_newkey(L, t, &k, value);
   }
-  else
+  else {
     setobj2t(L, cast(TValue *, p), value);
+    luaC_barriertable(L, t, p, value);
+  }
 }
 
 
@@ -97,7 +97,7 @@ const char *luaT_objtypename (lua_State *L, const TValue *o) {
       (ttisfulluserdata(o) && (mt = uvalue(o)->metatable) != NULL)) {
     const TValue *name = luaH_getshortstr(mt, luaS_new(L, "__name"));
     if (ttisstring(name))  /* is '__name' a string? ，'__name'是字符串吗？*/
-      return getstr(tsvalue(name));  /* use it as type name */
+      return luaS_cstr(L, tsvalue(name));  /* use it as type name */
   }
   return ttypename(ttype(o));  /* else use standard type name 否则使用标准类型名称 */
 }
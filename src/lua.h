@@ -162,6 +162,58 @@ typedef void * (*lua_Alloc) (void *ud, void *ptr, size_t osize, size_t nsize);
 typedef void (*lua_WarnFunction) (void *ud, const char *msg, int tocont);
 
 
+/*
+** Type for functions called when memory use crosses a limit
+** 内存使用超过限制时调用的函数的类型
+*/
+typedef void (*lua_MemLimitFunction) (void *ud, int hard, size_t inuse);
+
+
+/*
+** Statistics of the garbage collector
+** 垃圾收集器的统计信息
+*/
+typedef struct lua_GCStats {
+  int mode;  /* current mode (LUA_GCINC or LUA_GCGEN) */
+  int adaptive;  /* true if the collector chooses its mode by itself */
+  size_t cycles;  /* number of complete (non-minor) collections */
+  size_t minors;  /* number of minor collections */
+  size_t switches;  /* number of automatic switches of mode */
+  const char *lastswitch;  /* reason for the last switch (NULL if none) */
+  size_t finpending;  /* number of objects waiting for their finalizers */
+  size_t finalized;  /* number of objects already finalized */
+  size_t largebytes;  /* bytes in large strings and userdata */
+  size_t pretenured;  /* number of objects created old */
+} lua_GCStats;
+
+
+/*
+** Kinds of collectable objects counted by 'lua_gctypes'
+** 'lua_gctypes' 统计的可回收对象种类
+*/
+#define LUA_GCKTABLE	0
+#define LUA_GCKSHRSTR	1
+#define LUA_GCKLNGSTR	2
+#define LUA_GCKLCL	3
+#define LUA_GCKCCL	4
+#define LUA_GCKUDATA	5
+#define LUA_GCKTHREAD	6
+#define LUA_GCKPROTO	7
+#define LUA_GCKUPVAL	8
+
+#define LUA_NUMGCKINDS	9
+
+
+/*
+** Objects and bytes of each kind
+** 每种对象的数量和字节数
+*/
+typedef struct lua_GCTypes {
+  size_t count[LUA_NUMGCKINDS];  /* number of objects of each kind */
+  size_t bytes[LUA_NUMGCKINDS];  /* bytes used by objects of each kind */
+} lua_GCTypes;
+
+
 
 
 /*
@@ -223,6 +275,7 @@ LUA_API lua_Number      (lua_tonumberx) (lua_State *L, int idx, int *isnum);
 LUA_API lua_Integer     (lua_tointegerx) (lua_State *L, int idx, int *isnum);
 LUA_API int             (lua_toboolean) (lua_State *L, int idx);
 LUA_API const char     *(lua_tolstring) (lua_State *L, int idx, size_t *len);
+LUA_API const char     *(lua_tolbytes) (lua_State *L, int idx, size_t *len);
 LUA_API lua_Unsigned    (lua_rawlen) (lua_State *L, int idx);
 LUA_API lua_CFunction   (lua_tocfunction) (lua_State *L, int idx);
 LUA_API void	       *(lua_touserdata) (lua_State *L, int idx);
@@ -268,6 +321,10 @@ LUA_API void        (lua_pushnumber) (lua_State *L, lua_Number n);
 LUA_API void        (lua_pushinteger) (lua_State *L, lua_Integer n);
 LUA_API const char *(lua_pushlstring) (lua_State *L, const char *s, size_t len);
 LUA_API const char *(lua_pushstring) (lua_State *L, const char *s);
+LUA_API const char *(lua_pushexternalstring) (lua_State *L,
+                const char *s, size_t len, lua_Alloc falloc, void *ud);
+LUA_API void        (lua_pushsubstring) (lua_State *L, int idx, size_t i,
+                                                     size_t len);
 LUA_API const char *(lua_pushvfstring) (lua_State *L, const char *fmt,
                                                       va_list argp);
 LUA_API const char *(lua_pushfstring) (lua_State *L, const char *fmt, ...);
@@ -325,6 +382,8 @@ LUA_API int   (lua_load) (lua_State *L, lua_Reader reader, void *dt,
 
 LUA_API int (lua_dump) (lua_State *L, lua_Writer writer, void *data, int strip);
 
+LUA_API int (lua_heapsnapshot) (lua_State *L, lua_Writer writer, void *data);
+
 
 /*
 ** coroutine functions 协程函数
@@ -362,9 +421,28 @@ LUA_API void (lua_warning)  (lua_State *L, const char *msg, int tocont);
 #define LUA_GCISRUNNING		9 // 正在运行
 #define LUA_GCGEN		10 // 生成
 #define LUA_GCINC		11 // 加一
+#define LUA_GCSOFTLIMIT		12 // 软内存限制
+#define LUA_GCHARDLIMIT		13 // 硬内存限制
+#define LUA_GCALLOCSAMPLE	14 // 分配采样
+#define LUA_GCADAPTIVE		15 // 自适应
+#define LUA_GCFINBUDGET		16 // 终结器时间预算
+#define LUA_GCFINALIZE		17 // 运行终结器
+#define LUA_GCSTEPUS		18 // 按时间步进
 
 LUA_API int (lua_gc) (lua_State *L, int what, ...);
 
+LUA_API void (lua_setmemlimitf) (lua_State *L, lua_MemLimitFunction f,
+                                 void *ud);
+
+LUA_API void (lua_gcstats) (lua_State *L, lua_GCStats *stats);
+LUA_API void (lua_gctypes) (lua_State *L, lua_GCTypes *types);
+
+LUA_API void (lua_pushregion) (lua_State *L);
+LUA_API int  (lua_popregion)  (lua_State *L);
+
+LUA_API int (lua_allocprofile) (lua_State *L, lua_Writer writer, void *data,
+                                int reset);
+
 
 /*
 ** miscellaneous functions 杂项函数
@@ -382,6 +460,14 @@ LUA_API size_t   (lua_stringtonumber) (lua_State *L, const char *s);
 LUA_API lua_Alloc (lua_getallocf) (lua_State *L, void **ud);
 LUA_API void      (lua_setallocf) (lua_State *L, lua_Alloc f, void *ud);
 
+/*
+** modes for string comparison 字符串比较模式
+*/
+#define LUA_STRCMPLOCALE	0 // 按区域设置（'strcoll'）
+#define LUA_STRCMPBYTES	1 // 逐字节（'memcmp'）
+
+LUA_API int (lua_setstrcmp) (lua_State *L, int mode);
+
 LUA_API void (lua_toclose) (lua_State *L, int idx);
 LUA_API void (lua_closeslot) (lua_State *L, int idx);
 
@@ -71,6 +71,7 @@
 #if defined(LUA_USE_LINUX)
 #define LUA_USE_POSIX
 #define LUA_USE_DLOPEN		/* needs an extra library: -ldl */
+#define LUA_USE_MMAP		/* large blocks go directly to 'mmap' */
 #endif
 
 
@@ -420,6 +421,8 @@
 ** by prefixing it with one of FLT/DBL/LDBL.
 @@ LUA_NUMBER_FRMLEN is the length modifier for writing floats.
 @@ LUA_NUMBER_FMT is the format for writing floats.
+@@ LUAI_NUMDIGITS is the precision of LUA_NUMBER_FMT, when that format
+** is a plain "%.<n>g" over a 'double' (see LUA_NOFASTFMT).
 @@ lua_number2str converts a float to a string.
 @@ l_mathop allows the addition of an 'l' or 'f' to all math operations.
 @@ l_floor takes the floor of a float.
@@ -492,6 +495,7 @@
 
 #define LUA_NUMBER_FRMLEN	""
 #define LUA_NUMBER_FMT		"%.14g"
+#define LUAI_NUMDIGITS		14
 
 #define l_mathop(op)		op
 
@@ -527,6 +531,24 @@
 #define lua_integer2str(s,sz,n)  \
 	l_sprintf((s), sz, LUA_INTEGER_FMT, (LUAI_UACINT)(n))
 
+
+/*
+@@ LUA_NOFASTFMT makes Lua always convert numbers to strings with
+** 'lua_integer2str' and 'lua_number2str', and decimal numerals to
+** floats with 'lua_str2number'. Otherwise, Lua uses its own faster
+** conversions (see 'tostringbuff' and 'l_str2d' in lobject.c), which
+** give the same results as LUA_INTEGER_FMT, as 'strtod' and, when
+** LUAI_NUMDIGITS is defined, as LUA_NUMBER_FMT. Define it if you change
+** those formats or 'lua_str2number'. (Script 'etc/numfmt.lua' checks
+** the conversion to strings against the C library.)
+** LUA_NOFASTFMT 使Lua总是用 'lua_integer2str' 和 'lua_number2str' 将数字转换为
+** 字符串，并用 'lua_str2number' 将十进制数字转换为浮点数。否则Lua使用自己更快的
+** 转换，其结果与 LUA_INTEGER_FMT、'strtod' 和（定义了 LUAI_NUMDIGITS 时）
+** LUA_NUMBER_FMT 相同。如果更改了这些格式或 'lua_str2number'，请定义它。
+**（脚本 'etc/numfmt.lua' 将到字符串的转换与C库进行比对。）
+*/
+/* #define LUA_NOFASTFMT */
+
 /*
 ** use LUAI_UACINT here to avoid problems with promotions (which
 ** can turn a comparison between unsigneds into a signed comparison)
@@ -739,6 +761,17 @@
 /* #define LUA_NOCVTS2N */
 
 
+/*
+@@ LUA_BYTECMP makes new states compare strings byte by byte (with
+** 'memcmp') in the order operators, instead of with 'strcoll', which
+** respects the current locale. Each state can still change its mode
+** with 'lua_setstrcmp'.
+** LUA_BYTECMP 使新状态在顺序运算符中逐字节（用'memcmp'）比较字符串，而不是用
+** 遵循当前区域设置的'strcoll'。每个状态仍可以用'lua_setstrcmp'更改其模式。
+*/
+/* #define LUA_BYTECMP */
+
+
 /*
 @@ LUA_USE_APICHECK turns on several consistency checks on the C API.
 ** LUA_USE_APICHECK 打开了C API上的几个一致性检查
@@ -808,6 +841,16 @@
 #define LUAL_BUFFERSIZE   ((int)(16 * sizeof(void*) * sizeof(lua_Number)))
 
 
+/*
+@@ LUAI_LARGEOBJ is the size (in bytes) from which strings and userdata
+@@ form the large-object space of the collector and from which, with
+@@ LUA_USE_MMAP, the default allocator maps blocks directly.
+** LUAI_LARGEOBJ 是字符串和用户数据进入回收器大对象空间的大小（字节），
+** 在定义了 LUA_USE_MMAP 时也是默认分配器直接映射内存块的大小。
+*/
+#define LUAI_LARGEOBJ	(256 * 1024)
+
+
 /*
 @@ LUAI_MAXALIGN defines fields that, when used in a union, ensure
 ** maximum alignment for the other items in that union.
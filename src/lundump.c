@@ -273,6 +273,7 @@ static void loadFunction (LoadState *S, Proto *f, TString *psource) {
   loadUpvalues(S, f);
   loadProtos(S, f);
   loadDebug(S, f);
+  luaF_countproto(S->L, f);
 }
 
 
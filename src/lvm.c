@@ -86,12 +86,12 @@
 ** If the value is not a string or is a string not representing
 ** a valid numeral (or if coercions from strings to numbers
 ** are disabled via macro 'cvt2num'), do not modify 'result'
-** and return 0.
+** and return 0. (Slices are never numerals; see 'luaS_sub'.)
 */
 static int l_strton (const TValue *obj, TValue *result) {
   lua_assert(obj != result);
-  if (!cvt2num(obj))  /* is object not a string? */
-    return 0;
+  if (!cvt2num(obj) || strisslice(tsvalue(obj)))
+    return 0;  /* not a string or not a numeral */
   else
     return (luaO_str2num(svalue(obj), result) == vslen(obj) + 1);
 }
@@ -340,7 +340,6 @@ void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
       if (tm == NULL) {  /* no metamethod? */
         luaH_finishset(L, h, key, slot, val);  /* set new value */
         invalidateTMcache(h);
-        luaC_barrierback(L, obj2gco(h), val);
         return;
       }
       /* else will try the metamethod */
@@ -371,13 +370,27 @@ void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
 ** -greater than zero if 'ls' is less-equal-greater than 'rs'.
 ** The code is a little tricky because it allows '\0' in the strings
 ** and it uses 'strcoll' (to respect locales) for each segments
-** of the strings.
+** of the strings. ('strcoll' needs a final '\0', so slices must be
+** materialized.) In mode LUA_STRCMPBYTES, strings are ordered by
+** their bytes (as unsigned chars), with a prefix before the longer
+** string; 'memcmp' handles '\0' like any other byte.
 */
-static int l_strcmp (const TString *ls, const TString *rs) {
-  const char *l = getstr(ls);
+static int l_strcmp (lua_State *L, TString *ls, TString *rs) {
+  const char *l;
   size_t ll = tsslen(ls);
-  const char *r = getstr(rs);
+  const char *r;
   size_t lr = tsslen(rs);
+  if (ls == rs)  /* same string? */
+    return 0;
+  if (G(L)->strcmpmode == LUA_STRCMPBYTES) {
+    int temp = memcmp(getstr(ls), getstr(rs), (ll < lr) ? ll : lr);
+    if (temp != 0)
+      return temp;
+    else  /* equal up to the length of the shorter one */
+      return (ll < lr) ? -1 : (ll > lr);
+  }
+  l = luaS_cstr(L, ls);
+  r = luaS_cstr(L, rs);
   for (;;) {  /* for each segment */
     int temp = strcoll(l, r);
     if (temp != 0)  /* not equal? */
@@ -521,7 +534,7 @@ l_sinline int LEnum (const TValue *l, const TValue *r) {
 static int lessthanothers (lua_State *L, const TValue *l, const TValue *r) {
   lua_assert(!ttisnumber(l) || !ttisnumber(r));
   if (ttisstring(l) && ttisstring(r))  /* both are strings? */
-    return l_strcmp(tsvalue(l), tsvalue(r)) < 0;
+    return l_strcmp(L, tsvalue(l), tsvalue(r)) < 0;
   else
     return luaT_callorderTM(L, l, r, TM_LT);
 }
@@ -543,7 +556,7 @@ int luaV_lessthan (lua_State *L, const TValue *l, const TValue *r) {
 static int lessequalothers (lua_State *L, const TValue *l, const TValue *r) {
   lua_assert(!ttisnumber(l) || !ttisnumber(r));
   if (ttisstring(l) && ttisstring(r))  /* both are strings? */
-    return l_strcmp(tsvalue(l), tsvalue(r)) <= 0;
+    return l_strcmp(L, tsvalue(l), tsvalue(r)) <= 0;
   else
     return luaT_callorderTM(L, l, r, TM_LE);
 }
@@ -784,15 +797,17 @@ lua_Integer luaV_shiftl (lua_Integer x, lua_Integer y) {
 
 /*
 ** create a new Lua closure, push it in the stack, and initialize
-** its upvalues.
+** its upvalues. ('pc' is the instruction creating it.)
 */
 static void pushclosure (lua_State *L, Proto *p, UpVal **encup, StkId base,
-                         StkId ra) {
+                         StkId ra, const Instruction *pc) {
   int nup = p->sizeupvalues;
   Upvaldesc *uv = p->upvalues;
   int i;
   LClosure *ncl = luaF_newLclosure(L, nup);
+  luaC_allocsite(L, ncl, pc);
   ncl->p = p;
+  luaC_objbarrier(L, ncl, p);  /* 'ncl' may be old */
   setclLvalue2s(L, ra, ncl);  /* anchor new closure in stack */
   for (i = 0; i < nup; i++) {  /* fill in its upvalues */
     if (uv[i].instack)  /* upvalue refers to local variable? */
@@ -1349,6 +1364,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         pc++;  /* skip extra argument */
         L->top = ra + 1;  /* correct top in case of emergency GC */
         t = luaH_new(L);  /* memory allocation */
+        luaC_allocsite(L, t, pc);
         sethvalue2s(L, ra, t);
         if (b != 0 || c != 0)
           luaH_resize(L, t, c, b);  /* idem */
@@ -1805,14 +1821,14 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         for (; n > 0; n--) {
           TValue *val = s2v(ra + n);
           setobj2t(L, &h->array[last - 1], val);
+          luaC_barriertable(L, h, &h->array[last - 1], val);
           last--;
-          luaC_barrierback(L, obj2gco(h), val);
         }
         vmbreak;
       }
       vmcase(OP_CLOSURE) {
         Proto *p = cl->p->p[GETARG_Bx(i)];
-        halfProtect(pushclosure(L, p, cl->upvals, base, ra));
+        halfProtect(pushclosure(L, p, cl->upvals, base, ra, pc));
         checkGC(L, ra + 1);
         vmbreak;
       }
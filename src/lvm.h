@@ -114,7 +114,7 @@ typedef enum {
 */
 #define luaV_finishfastset(L,t,slot,v) \
     { setobj2t(L, cast(TValue *,slot), v); \
-      luaC_barrierback(L, gcvalue(t), v); }
+      luaC_barriertable(L, hvalue(t), slot, v); }
 
 
 